@@ -1,11 +1,18 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <memory>
 #include <random>
 #include <iostream>
+#include <stdlib.h>
 
+#include "common/bench.hpp"
+#include "common/circle_batch.hpp"
+#include "common/math.hpp"
+#include "common/thread_pool.hpp"
+#include "common/vec2.hpp"
 
-// Globals, functions & classes
-const double    pi = 2.0 * acos(0.0);   //!<  Pi.
 
+// Globals, functions & classes
 
 /**
  * Gets the area of a circle with the given radius.
@@ -29,524 +36,762 @@ float getRad(float area) {
 
 
 /**
- * A class for simple 2D vectors.
+ * A class for simple lines.
  */
-class Vec2 {
+class Line {
 public:
-    float   x,  //!<  x-position (width)
-            y;  //!<  y-position (height)
+    Vec2    origo;  //!<  Origo
+    float   ang;    //!<  Angle
 
     /**
-     * Standard constructor.
+     * Default constructor.
      */
-    Vec2 () {};
+    Line () {};
 
     /**
-     * Constructor.
+     * Point-angle constructor.
      */
-    Vec2 (float xpos, float ypos) {
-        x = xpos;
-        y = ypos;
+    Line (Vec2 origo, float angle) {
+        this->origo = origo;
+        ang = angle;
     }
 
     /**
-     * sf::Vector2f copy constructor.
+     * Gets direction of line as a Vec2.
      */
-    Vec2 (sf::Vector2f vec) {
-        x = vec.x;
-        y = vec.y;
+    Vec2 getDir () {
+        return Vec2 (cos(ang), sin(ang));
     }
 
     /**
-     * sf::Vector2i copy constructor.
+     * Localizes a point so that it's relative to this line.
+     *
+     * @param vec - The vector to localize.
+     * @return A new Vec2 object that is vec, but localized so that it's relative to this line.
      */
-    Vec2 (sf::Vector2i vec) {
-        x = (float) vec.x;
-        y = (float) vec.y;
+    Vec2 localize (Vec2 point) {
+        return (point - origo).rot(-ang);
     }
 
     /**
-     * Cout
+     * Globalizes a point so that it's relative to the screen.
      */
-    friend std::ostream& operator<< (std::ostream& os, const Vec2 vec) {
-        os << "(" << vec.x << ", " << vec.y << ")";
-        return os;
+    Vec2 globalize (Vec2 point) {
+        return point.rot(ang) + origo;
     }
 
     /**
-     * Addition by another Vec2.
+     * Draws the line.
      *
-     * @param vec - The vector to add.
-     * @return This vector, added with 'vec'.
+     * @param window - Pointer to the window which to draw the line onto.
      */
-    Vec2 operator+= (Vec2 vec) {
-        x += vec.x;
-        y += vec.y;
-        return (*this);
-    }
-    Vec2 operator+ (Vec2 vec) {
-        Vec2 ret;
-        ret.x = x + vec.x;
-        ret.y = y + vec.y;
-        return ret;
+    void draw (sf::RenderWindow* window) {
+        sf::Vertex line[2];
+        Vec2 dir = getDir();
+        Vec2 p0 = origo - dir * 9999.f;
+        Vec2 p1 = origo + dir * 9999.f;
+        line[0].position = sf::Vector2f(p0.x, p0.y);
+        line[0].color  = sf::Color::White;
+        line[1].position = sf::Vector2f(p1.x, p1.y);
+        line[1].color = sf::Color::White;
+        window->draw(line, 2, sf::Lines);
+
+        sf::CircleShape           origoMarker;
+        origoMarker.setRadius    (5);
+        origoMarker.setFillColor (sf::Color::White);
+        origoMarker.setOrigin    (5, 5);
+        origoMarker.setPosition  (origo.x, origo.y);
+        window->draw             (origoMarker);
+
+        Vec2 p3 = origo + dir * 100.f;
+        sf::CircleShape               directionMarker;
+        directionMarker.setRadius    (3);
+        directionMarker.setFillColor (sf::Color::White);
+        directionMarker.setOrigin    (3, 3);
+        directionMarker.setPosition  (p3.x, p3.y);
+        window->draw                 (directionMarker);
     }
+};
+
+
+/**
+ * A hierarchical spatial hash used as broad-phase for circle collisions.
+ * Circles are sorted into levels by size (the cell size doubles for every level), so that a single huge circle
+ * doesn't force a huge cell size onto all of the small ones. The topmost level is a single cell covering everything.
+ * Each cell is an intrusive linked list through the entries, so nothing is allocated once the hash fits its entries.
+ */
+class SpatialHash {
+public:
 
     /**
-     * Subtraction by another Vec2.
+     * Constructor.
      *
-     * @param vec - The vector to subtract.
-     * @return This vector, subtracted by 'vec'.
+     * @param width - Width of the hashed area.
+     * @param height - Height of the hashed area.
+     * @param baseCellSize - Cell size of the finest level.
      */
-    Vec2 operator-= (Vec2 vec) {
-        x -= vec.x;
-        y -= vec.y;
-        return (*this);
-    }
-    Vec2 operator- (Vec2 vec) {
-        Vec2 ret;
-        ret.x = x - vec.x;
-        ret.y = y - vec.y;
-        return ret;
+    SpatialHash (float width, float height, float baseCellSize) {
+        float cellSize  = baseCellSize;
+        int   cellCount = 0;
+        while (true) {
+            Level level;
+            level.cellSize  = cellSize;
+            level.cols      = std::max (1, (int) ceil (width / cellSize));
+            level.rows      = std::max (1, (int) ceil (height / cellSize));
+            level.firstCell = cellCount;
+            levels.push_back (level);
+            cellCount += level.cols * level.rows;
+
+            if (level.cols == 1 && level.rows == 1) break;
+            cellSize *= 2.f;
+        }
+        cellHead.assign (cellCount, -1);
     }
 
     /**
-     * Division by number.
+     * Removes everything from the hash, making room for 'count' entries.
      *
-     * @param num - The number to divide by.
-     * @return This vector, divided by 'num'.
+     * @param count - How many entries (indices) the hash should be able to hold.
      */
-    Vec2 operator/= (float num) {
-        x /= num;
-        y /= num;
-        return (*this);
-    }
-    Vec2 operator/ (float n) {
-        Vec2 ret;
-        ret.x = x / n;
-        ret.y = y / n;
-        return ret;
+    void clear (int count) {
+        std::fill (cellHead.begin(), cellHead.end(), -1);
+        entryCell.assign (count, -1);
+        entryNext.assign (count, -1);
+        entryPrev.assign (count, -1);
     }
 
     /**
-     * Multiplication by number.
+     * Inserts an entry, or moves it if it's already in the hash and its cell has changed.
      *
-     * @param num - The number to multiplicate by.
-     * @return This vector, multiplied by 'num'.
+     * @param index - Index of the entry.
+     * @param pos - Position of the entry.
+     * @param rad - Radius of the entry.
      */
-    Vec2 operator*= (float num) {
-        x *= num;
-        y *= num;
-        return (*this);
-    }
-    Vec2 operator* (float n) {
-        Vec2 ret;
-        ret.x = x * n;
-        ret.y = y * n;
-        return ret;
-    }
-    friend Vec2 operator* (float n, Vec2 u) {
-        return u * n;
+    void relocate (int index, Vec2 pos, float rad) {
+        int cell = getCell (getLevel (rad), pos);
+        if ( cell == entryCell[index] ) return;
+
+        remove (index);
+        entryCell[index] = cell;
+        entryPrev[index] = -1;
+        entryNext[index] = cellHead[cell];
+        if ( cellHead[cell] != -1 ) entryPrev[ cellHead[cell] ] = index;
+        cellHead[cell] = index;
     }
 
     /**
-     * Dot product.
+     * Removes an entry from the hash.
      *
-     * @param vec - The vector to dot with.
-     * @return The dot product between this and 'vec'.
+     * @param index - Index of the entry.
      */
-    float operator* (Vec2 vec) {
-        return x*vec.x + y*vec.y;
+    void remove (int index) {
+        int cell = entryCell[index];
+        if ( cell == -1 ) return;
+
+        int next = entryNext[index],
+            prev = entryPrev[index];
+        if ( prev != -1 )   entryNext[prev] = next;
+        else                cellHead[cell]  = next;
+        if ( next != -1 )   entryPrev[next] = prev;
+        entryCell[index] = -1;
     }
 
     /**
-     * Length.
+     * Checks whether an entry can be found by queries: it has to be in the cell containing its position, on a level
+     * whose cells are big enough for its radius.
      *
-     * @return The length of this vector.
+     * @param index - Index of the entry.
+     * @param pos - Position of the entry.
+     * @param rad - Radius of the entry.
+     * @return Whether or not the entry is where it should be.
      */
-    float len () {
-        return sqrt(pow(x,2) + pow(y,2));
+    bool covers (int index, Vec2 pos, float rad) {
+        for (int l=getLevel(rad); l<levels.size(); l++) {
+            if ( entryCell[index] == getCell(l, pos) ) return true;
+        }
+        return false;
     }
 
     /**
-     * Distance.
+     * Finds every entry that may be touching a circle.
      *
-     * @param vec - The other vector.
-     * @return Distance between this vector and the other.
+     * @param pos - Position of the circle.
+     * @param rad - Radius of the circle.
+     * @return Indices of all entries 'e' which might satisfy dist(pos, e.pos) < rad + e.rad, sorted ascendingly.
      */
-    float dist(Vec2 vec) {
-        return ((*this) - vec).len();
+    const std::vector <int>& query (Vec2 pos, float rad) {
+        query (pos, rad, found);
+        return found;
     }
 
     /**
-     * Normalization.
+     * Finds every entry that may be touching a circle, into a given vector.
+     * Doesn't change the hash, so several threads may query at once.
      *
-     * @return A new Vec2 that is this, normalized.
+     * @param pos - Position of the circle.
+     * @param rad - Radius of the circle.
+     * @param found - Vector which is filled with the indices, sorted ascendingly.
      */
-    Vec2 norm () {
-        return (*this) / (*this).len();
+    void query (Vec2 pos, float rad, std::vector <int>& found) const {
+        found.clear();
+
+        for (int l=0; l<levels.size(); l++) {
+            const Level&    level = levels[l];
+            float           reach = rad + level.cellSize / 2.f;  // Entries of a level have a radius of at most half its cell size
+            int     x0    = getCoord (pos.x - reach, level.cellSize, level.cols),
+                    x1    = getCoord (pos.x + reach, level.cellSize, level.cols),
+                    y0    = getCoord (pos.y - reach, level.cellSize, level.rows),
+                    y1    = getCoord (pos.y + reach, level.cellSize, level.rows);
+
+            // The topmost level holds everything too big for the others
+            if ( l == levels.size() - 1 ) {
+                x0 = 0; x1 = level.cols - 1;
+                y0 = 0; y1 = level.rows - 1;
+            }
+
+            for (int y=y0; y<=y1; y++) {
+                for (int x=x0; x<=x1; x++) {
+                    for (int e = cellHead[level.firstCell + y * level.cols + x]; e != -1; e = entryNext[e]) {
+                        found.push_back (e);
+                    }
+                }
+            }
+        }
+
+        std::sort (found.begin(), found.end());
     }
 
+private:
+
     /**
-     * Projection.
-     *
-     * @param vec - The vector that is projected onto this.
-     * @return A new Vec2 that is 'vec' projected onto this.
+     * A single level of the hash.
      */
-    Vec2 proj (Vec2 vec) {
-        return (*this) * ((*this)*vec / pow((*this).len(), 2));
-    }
+    struct Level {
+        float   cellSize;   //!<  Width and height of every cell
+        int     cols,       //!<  Amount of cells horizontally
+                rows,       //!<  Amount of cells vertically
+                firstCell;  //!<  Index of the level's first cell in 'cellHead'
+    };
+
+    std::vector <Level> levels;         //!<  Levels, from finest to coarsest
+    std::vector <int>   cellHead,       //!<  First entry of every cell, across all levels (-1 if empty)
+                        entryCell,      //!<  Which cell each entry is in (-1 if none)
+                        entryNext,      //!<  Next entry in the same cell (-1 if last)
+                        entryPrev,      //!<  Previous entry in the same cell (-1 if first)
+                        found;          //!<  Result of the last query
 
     /**
-     * Reflection.
+     * Gets the finest level which fits a circle.
      *
-     * @param vec - A vector.
-     * @return A new Vec2 that is 'vec' reflected about this.
+     * @param rad - Radius of the circle.
+     * @return The level.
      */
-    Vec2 refl (Vec2 vec) {
-        return (*this).proj(vec) * 2 - vec;
+    int getLevel (float rad) {
+        for (int l=0; l<levels.size()-1; l++) {
+            if ( rad * 2.f <= levels[l].cellSize ) return l;
+        }
+        return levels.size() - 1;
     }
 
     /**
-     * Orthagonal.
+     * Gets the cell-coordinate of a position along one axis, clamped to the hashed area.
+     * Clamping keeps things correct for circles outside the area, since it never separates two cells that overlap.
      *
-     * @return A new Vec2 which is orthagonal to this.
+     * @param p - The position.
+     * @param cellSize - Size of the cells.
+     * @param cellCount - Amount of cells along the axis.
+     * @return The coordinate.
      */
-    Vec2 orth () {
-        return Vec2 (-y, x);
+    int getCoord (float p, float cellSize, int cellCount) const {
+        float c = floor (p / cellSize);
+        if      ( !(c >= 0.f) )     c = 0.f;    // Also catches NaN
+        else if ( c > cellCount-1 ) c = cellCount - 1;
+        return (int) c;
     }
 
     /**
-     * Rotation.
+     * Gets the index of the cell containing a position, in 'cellHead'.
      *
-     * @param angle - Angle to rotate with.
-     * @return A new Vec2 which is this rotated 'angle' around origo.
+     * @param level - The level.
+     * @param pos - The position.
+     * @return The cell index.
      */
-    Vec2 rot (float angle) {
-        return Vec2 ( cos(angle) * x - sin(angle) * y,
-                      sin(angle) * x + cos(angle) * y );
+    int getCell (int level, Vec2 pos) {
+        Level& l = levels[level];
+        return l.firstCell + getCoord (pos.y, l.cellSize, l.rows) * l.cols + getCoord (pos.x, l.cellSize, l.cols);
     }
 };
 
 
 /**
- * A class for simple lines.
+ * Structure-of-arrays storage for circles that bounce around and absorb eachother.
+ * Every property lives in its own contiguous array, and a circle is just an index into them.
+ * Slots of dead circles are kept in a free list and reused by the next circle that is added.
  */
-class Line {
+class CircleStore {
 public:
-    Vec2    origo;  //!<  Origo
-    float   ang;    //!<  Angle
-
-    /**
-     * Default constructor.
-     */
-    Line () {};
+    std::vector <Vec2>      pos,                //!<  Position of each circle
+                            vel;                //!<  Velocity of each circle
+    std::vector <float>     rad;                //!<  Radius of each circle
+    std::vector <sf::Color> color;              //!<  Color of each circle
+    std::vector <char>      alive,              //!<  Whether or not each circle is 'alive' (char, since std::vector<bool> packs bits)
+                            collidesWithLines;  //!<  Whether or not each circle collides with lines
 
     /**
-     * Point-angle constructor.
+     * Gets the amount of slots, dead or alive.
+     *
+     * @return The amount of slots.
      */
-    Line (Vec2 origo, float angle) {
-        this->origo = origo;
-        ang = angle;
+    int size () {
+        return rad.size();
     }
 
     /**
-     * Gets direction of line as a Vec2.
+     * Adds a circle, reusing a dead slot if there is one.
+     *
+     * @param position - Position of the circle.
+     * @param velocity - Velocity of the circle.
+     * @param radius - Radius of the circle.
+     * @return Index of the new circle.
      */
-    Vec2 getDir () {
-        return Vec2 (cos(ang), sin(ang));
+    int add (Vec2 position, Vec2 velocity, float radius) {
+        int index;
+        if ( !freeSlots.empty() ) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = size();
+            pos.emplace_back();
+            vel.emplace_back();
+            rad.emplace_back();
+            color.emplace_back();
+            alive.emplace_back();
+            collidesWithLines.emplace_back();
+        }
+
+        pos[index]                  = position;
+        vel[index]                  = velocity;
+        rad[index]                  = radius;
+        color[index]                = sf::Color::Yellow;
+        alive[index]                = true;
+        collidesWithLines[index]    = true;
+        return index;
     }
 
     /**
-     * Localizes a point so that it's relative to this line.
+     * Kills a circle, freeing its slot.
      *
-     * @param vec - The vector to localize.
-     * @return A new Vec2 object that is vec, but localized so that it's relative to this line.
+     * @param index - Index of the circle.
      */
-    Vec2 localize (Vec2 point) {
-        return (point - origo).rot(-ang);
+    void kill (int index) {
+        alive[index] = false;
+        freeSlots.push_back(index);
     }
 
     /**
-     * Globalizes a point so that it's relative to the screen.
+     * Removes every circle. The arrays keep their capacity.
      */
-    Vec2 globalize (Vec2 point) {
-        return point.rot(ang) + origo;
+    void clear () {
+        pos.clear();
+        vel.clear();
+        rad.clear();
+        color.clear();
+        alive.clear();
+        collidesWithLines.clear();
+        freeSlots.clear();
     }
 
-    /**
-     * Draws the line.
-     *
-     * @param window - Pointer to the window which to draw the line onto.
-     */
-    void draw (sf::RenderWindow* window) {
-        sf::Vertex line[2];
-        Vec2 dir = getDir();
-        Vec2 p0 = origo - dir * 9999.f;
-        Vec2 p1 = origo + dir * 9999.f;
-        line[0].position = sf::Vector2f(p0.x, p0.y);
-        line[0].color  = sf::Color::White;
-        line[1].position = sf::Vector2f(p1.x, p1.y);
-        line[1].color = sf::Color::White;
-        window->draw(line, 2, sf::Lines);
-
-        sf::CircleShape           origoMarker;
-        origoMarker.setRadius    (5);
-        origoMarker.setFillColor (sf::Color::White);
-        origoMarker.setOrigin    (5, 5);
-        origoMarker.setPosition  (origo.x, origo.y);
-        window->draw             (origoMarker);
-
-        Vec2 p3 = origo + dir * 100.f;
-        sf::CircleShape               directionMarker;
-        directionMarker.setRadius    (3);
-        directionMarker.setFillColor (sf::Color::White);
-        directionMarker.setOrigin    (3, 3);
-        directionMarker.setPosition  (p3.x, p3.y);
-        window->draw                 (directionMarker);
-    }
+private:
+    std::vector <int>   freeSlots;  //!<  Slots of dead circles, ready for reuse
 };
 
 
 /**
- * A class for circles that bounce around and absorb eachother.
+ * Everything the physics step works on: the circles, the lines they bounce off and the broad-phase.
+ * Circles are updated through this shared context rather than by handing every circle copies of everything.
  */
-class Circle {
+class World {
 public:
-    Vec2        pos,              //!<  Position of the Circle
-                vel;              //!<  Velocity of the Circle
-    float       rad;              //!<  Radius of the Circle
-    sf::Color   color;            //!<  Color of the circle
-    bool        alive,            //!<  Whether or not the circle is 'alive'
-                collidesWithLines; //!<  Whether or not the circle collides with lines
+    float                   resX,       //!<  Screen width
+                            resY;       //!<  Screen height
+    CircleStore             circles;    //!<  All circles
+    std::vector <Line>      lines;      //!<  All lines
+    SpatialHash             grid;       //!<  Broad-phase for circle collisions
+    bool                    bruteForce = false; //!<  Whether the ordered step checks every circle instead of asking the broad-phase
 
     /**
-     * Default constructor.
+     * Constructor.
+     *
+     * @param width - Width of the screen.
+     * @param height - Height of the screen.
      */
-    Circle () {};
+    World (float width, float height) : grid(width, height, 16.f) {
+        resX = width;
+        resY = height;
+    }
 
     /**
-     * Constructor.
+     * Sets how the world is stepped.
+     * With 0 threads every circle is updated in order, eating as it goes (the way the game always worked).
+     * With 1 or more, the parallel two-phase step is used instead, which gives the same result for any amount of threads.
+     *
+     * @param threadCount - Amount of threads, or 0 for the ordered step.
      */
-    Circle (Vec2 position, Vec2 velocity, float radius) {
-        pos = position;
-        vel = velocity;
-        rad = radius;
-        color = sf::Color::Yellow;
-        alive = true;
-        collidesWithLines = true;
+    void setThreads (int threadCount) {
+        pool.reset();
+        if (threadCount > 0) pool.reset(new ThreadPool(threadCount));
     }
 
     /**
-     * SFML Copy constructor.
+     * Advances every living circle by one tick.
+     * Doesn't allocate once the arrays and the broad-phase have grown to fit the circles.
+     *
+     * @param dt - How much time passed since last step.
+     * @return The total area of the living circles.
      */
-    Circle (sf::CircleShape circle) {
-        pos = circle.getPosition();
-        vel = Vec2 (0, 0);
-        rad = circle.getRadius();
-        color = circle.getFillColor();
-        alive = true;
+    float step (float dt) {
+        if (pool) return stepParallel(dt);
+        return stepOrdered(dt);
     }
 
     /**
-     * Updates the disk.
+     * Advances every living circle by one tick, in order.
+     * Every circle moves and then eats from the current state, so the result depends on the order.
      *
+     * @param dt - How much time passed since last step.
+     * @return The total area of the living circles, each measured right before its own update.
+     */
+    float stepOrdered (float dt) {
+        // Rebuild broad-phase
+        grid.clear(circles.size());
+        for (int i=0; i<circles.size(); i++) {
+            if ( circles.alive[i] ) grid.relocate(i, circles.pos[i], circles.rad[i]);
+        }
+        if (bruteForce) {
+            everyCircle.resize(circles.size());
+            for (int i=0; i<circles.size(); i++) everyCircle[i] = i;
+        }
+
+        // Update
+        float totalArea = 0.f;
+        for (int i=0; i<circles.size(); i++) {
+            if ( circles.alive[i] ) {
+                totalArea += getArea( circles.rad[i] );
+                update(i, dt);
+            }
+        }
+        return totalArea;
+    }
+
+    /**
+     * Advances every living circle by one tick, in two phases.
+     * First, every circle is moved and all eat-contacts are found from the same snapshot, in parallel.
+     * Then, the contacts are applied on one thread in the order of (eater, eaten), so the thread count doesn't matter.
+     *
+     * @param dt - How much time passed since last step.
+     * @return The total area of the living circles, measured before the step.
+     */
+    float stepParallel (float dt) {
+        int circleCount = circles.size(),
+            chunkCount  = (circleCount + chunkSize - 1) / chunkSize;
+
+        if (chunkContacts.size() < chunkCount) {
+            chunkContacts.resize(chunkCount);
+            chunkCandidates.resize(chunkCount);
+        }
+
+        float totalArea = 0.f;
+        for (int i=0; i<circleCount; i++) {
+            if ( circles.alive[i] ) totalArea += getArea( circles.rad[i] );
+        }
+
+        // Move
+        auto moveJob = [&] (int chunk) {
+            int end = std::min( (chunk + 1) * chunkSize, circleCount );
+            for (int i = chunk * chunkSize; i < end; i++) {
+                if ( circles.alive[i] ) move(i, dt);
+            }
+        };
+        pool->run(chunkCount, moveJob);
+
+        // Rebuild broad-phase
+        grid.clear(circleCount);
+        for (int i=0; i<circleCount; i++) {
+            if ( circles.alive[i] ) grid.relocate(i, circles.pos[i], circles.rad[i]);
+        }
+
+        // Find contacts
+        auto contactJob = [&] (int chunk) {
+            std::vector <Contact>&  contacts   = chunkContacts[chunk];
+            std::vector <int>&      candidates = chunkCandidates[chunk];
+            int                     end        = std::min( (chunk + 1) * chunkSize, circleCount );
+
+            contacts.clear();
+            for (int i = chunk * chunkSize; i < end; i++) {
+                if ( !circles.alive[i] ) continue;
+
+                Vec2    p = circles.pos[i];
+                float   r = circles.rad[i];
+                grid.query(p, r, candidates);
+
+                for (int c=0; c<candidates.size(); c++) {
+                    int j = candidates[c];
+                    if ( j != i && r > circles.rad[j] && p.dist( circles.pos[j] ) < r + circles.rad[j] ) {
+                        contacts.push_back( Contact { i, j } );
+                    }
+                }
+            }
+        };
+        pool->run(chunkCount, contactJob);
+
+        // Apply contacts
+        for (int chunk=0; chunk<chunkCount; chunk++) {
+            std::vector <Contact>& contacts = chunkContacts[chunk];
+
+            for (int c=0; c<contacts.size(); c++) {
+                int eater = contacts[c].eater,
+                    eaten = contacts[c].eaten;
+                if ( !circles.alive[eater] || !circles.alive[eaten] ) continue;
+
+                float eatenArea = getArea( circles.rad[eaten] ),
+                      eatAmount = eatenArea * dt + 5.f;
+
+                // Devour entire circle if its radius is less than 5 (or if there's nothing more to eat)
+                if ( circles.rad[eaten] <= 5.f || eatAmount >= eatenArea ) {
+                    eatAmount = eatenArea;
+                    circles.kill(eaten);
+                }
+
+                // Transfer mass
+                circles.rad[eater] = getRad( getArea( circles.rad[eater] ) + eatAmount );
+                circles.rad[eaten] = getRad( eatenArea - eatAmount );
+            }
+        }
+
+        return totalArea;
+    }
+
+    /**
+     * Moves a single disk, bouncing it off lines and walls.
+     * Only touches the disk itself, so disks can be moved in parallel.
+     *
+     * @param index - Index of the disk.
      * @param dt - How much time passed since last update.
-     * @param lines - A vector of Line-pointers that this disk may collide with.
-     * @param circles - A vector of Circle-pointers that this may collide with.
-     * @param resX - Width of the screen.
-     * @param resY - Height of the screen.
      */
-    void update (float dt, std::vector <Line*> lines, std::vector <Circle*> circles, float resX, float resY) {
-        pos = pos + vel * dt;
+    void move (int index, float dt) {
+        Vec2    p = circles.pos[index] + circles.vel[index] * dt,
+                v = circles.vel[index];
+        float   r = circles.rad[index];
 
         // Collision with lines
-        if (collidesWithLines) {
+        if (circles.collidesWithLines[index]) {
             for (int i=0; i<lines.size(); i++) {
-                Line*   line = lines[i];
-                Vec2    localPos = line->localize(pos);
+                Line&   line = lines[i];
+                Vec2    localPos = line.localize(p);
 
                 // Check if disk is touching the line (and reflect it)
-                if ( localPos.y < rad ) {
-                    vel = ( line->getDir() ).refl(vel);
-                    localPos.y = rad;
-                    pos = line->globalize(localPos);
+                if ( localPos.y < r ) {
+                    v = ( line.getDir() ).refl(v);
+                    localPos.y = r;
+                    p = line.globalize(localPos);
                 }
             }
         }
 
         // Collision with walls
-        if (pos.x < rad) {
-            vel.x *= -1.f;
-            pos.x = rad;
-        } else if (pos.x > resX - rad) {
-            vel.x *= -1.f;
-            pos.x = resX - rad;
+        if (p.x < r) {
+            v.x *= -1.f;
+            p.x = r;
+        } else if (p.x > resX - r) {
+            v.x *= -1.f;
+            p.x = resX - r;
         }
-        if (pos.y < rad) {
-            vel.y *= -1.f;
-            pos.y = rad;
-        } else if (pos.y > resY - rad) {
-            vel.y *= -1.f;
-            pos.y = resY - rad;
+        if (p.y < r) {
+            v.y *= -1.f;
+            p.y = r;
+        } else if (p.y > resY - r) {
+            v.y *= -1.f;
+            p.y = resY - r;
         }
 
+        circles.pos[index] = p;
+        circles.vel[index] = v;
+    }
+
+    /**
+     * Updates a single disk: moves it, and lets it eat whatever it touches.
+     *
+     * @param index - Index of the disk.
+     * @param dt - How much time passed since last update.
+     */
+    void update (int index, float dt) {
+        std::vector <Vec2>&     pos     = circles.pos;
+        std::vector <float>&    rad     = circles.rad;
+        std::vector <char>&     alive   = circles.alive;
+
+        move(index, dt);
+
+        Vec2    p = pos[index];
+        float   r = rad[index];
+
         // Collision with circles
-        for (int i=0; i<circles.size(); i++) {
+        // Candidates come sorted by index, so they are visited in the same order as a loop over all circles would.
+        // The query is made a little wider than needed, and redone whenever eating makes this circle outgrow it.
+        grid.relocate(index, p, r);
+        float                   queryRad   = r * 1.1f;
+        const std::vector<int>& candidates = bruteForce ? everyCircle : grid.query(p, queryRad);
+
+        for (int c=0; c<candidates.size(); c++) {
+            int i = candidates[c];
 
             // Check if [i] is alive and not this circle
-            if ( circles[i]->alive && circles[i] != this ) {
-                Circle* circle = circles[i];
-                float   distance = pos.dist( circle->pos );
+            if ( alive[i] && i != index ) {
+                float distance = p.dist( pos[i] );
 
                 // If this circle can eat [i]
-                if ( rad > circle->rad && distance < rad + circle->rad) {
-                    float eatAmount = getArea(circle->rad) * dt + 5.f;
+                if ( r > rad[i] && distance < r + rad[i]) {
+                    float eatAmount = getArea(rad[i]) * dt + 5.f;
 
                     // Devour entire circle if its radius is less than 2
-                    if ( circle->rad <= 5.f ) {
-                        eatAmount       = getArea( circle->rad );
-                        circle->alive   = false;
+                    if ( rad[i] <= 5.f ) {
+                        eatAmount = getArea( rad[i] );
+                        circles.kill(i);
+                        grid.remove(i);
                     }
 
                     // Transfer mass
-                    rad         = getRad(getArea(rad) + eatAmount);
-                    circle->rad = getRad(getArea(circle->rad) - eatAmount);
+                    r       = getRad(getArea(r) + eatAmount);
+                    rad[i]  = getRad(getArea(rad[i]) - eatAmount);
+
+                    // Widen the query if this circle grew out of it, and continue after [i]
+                    if ( r > queryRad && !bruteForce ) {
+                        grid.relocate(index, p, r);
+                        queryRad = r * 1.1f;
+                        grid.query(p, queryRad);
+                        c = std::upper_bound(candidates.begin(), candidates.end(), i) - candidates.begin() - 1;
+                    }
                 }
             }
         }
-    }
 
-    /**
-     * Draws the disk.
-     *
-     * @param window - Pointer to the window which to draw the disk onto.
-     */
-    void draw (sf::RenderWindow* window) {
-        sf::CircleShape     circle;
-        circle.setRadius    (rad);
-        circle.setFillColor (color);
-        circle.setOrigin    (rad, rad);
-        circle.setPosition  (pos.x, pos.y);
-        window->draw        (circle);
+        // Move to the right level, since growing less than the query's margin can still cross into the next one
+        grid.relocate(index, p, r);
+        rad[index] = r;
     }
-};
-
 
 
+private:
 
+    /**
+     * One circle touching a smaller one, found by the parallel step.
+     */
+    struct Contact {
+        int     eater,  //!<  Index of the bigger circle
+                eaten;  //!<  Index of the smaller circle
+    };
+
+    static const int                    chunkSize = 256;    //!<  Circles per job-chunk in the parallel step
+    std::unique_ptr <ThreadPool>        pool;               //!<  Threads for the parallel step (none for the ordered step)
+    std::vector <std::vector <Contact>> chunkContacts;      //!<  Contacts found by each chunk
+    std::vector <std::vector <int>>     chunkCandidates;    //!<  Broad-phase query results of each chunk
+    std::vector <int>                   everyCircle;        //!<  Every index, the candidates of the brute-force step
+};
 
 
 /**
- * The main program.
+ * The game itself: the circles, the lines, the player and the rules that drive them.
+ * Nothing in here needs a window, so it can also be run headless.
  */
-int main()
-{
-    // Create window
-    int resX = 900; //!<  Screen width
-    int resY = 900; //!<  Screen height
-    sf::RenderWindow window(sf::VideoMode(resX, resY), "Agario");
-
-    // Set up psuedo-random number generator
-    std::random_device  rnddev;
-    std::mt19937        gen(rnddev());
-    std::uniform_real_distribution <float> dist(0, 1);
-
-    // Make line(s)
-    Line line1 (Vec2(0, resY/4), pi/4.f-pi/2.f);
-    std::vector <Line*> lines {&line1};
-
-    // Make player disk
-    std::vector <Circle*> circles;
-
-    Vec2  playerSpawnPos        = Vec2 (resX/16, resY/16);  // Player spawnpos
-    float playerRadius          = 20.f;                     // Player (spawn)size
-    float playerMoveSpeed       = 75.f;                     // How much velocity the player gains by 'jumping'
-    float playerMoveCooldown    = 0.1f;                     // How many seconds the player has to wait between each jump
-    float playerMoveTimer       = 0;
-
-    Circle* player              = new Circle (playerSpawnPos, Vec2(0,0), playerRadius);
-    player->color               = sf::Color::Red;
-    player->collidesWithLines   = false;
-    circles.push_back(player);
-
-    // Make other disks
-    float   enemyMoveSpeed        = 50.f,   // How fast enemies move (this remains constant)
-            enemyMinSize          = 5.f,    // Minimum enemy (spawn)size
-            enemyMaxSize          = 15.f;   // Maximum enemy (spawn)size
-    int     enemyCount            = 100;    // How many enemies there are
-
-    for (int i=1; i<enemyCount+1; i++) {
-        // Shoot disk out at a random angle between 135 and 225 degrees
-        float angle = dist(gen) * pi * 2.f;
-        Circle* circle = new Circle (Vec2 ( dist(gen)*resX , dist(gen)*resY ),
-                                     Vec2 ( cos(angle)*enemyMoveSpeed , sin(angle)*enemyMoveSpeed ),
-                                     dist(gen) * (enemyMaxSize - enemyMinSize) + enemyMinSize );
-        circles.push_back(circle);
-    }
-
-    // Set up clock
-    sf::Clock clock;
-    clock.restart();
-
-    float time = 0.f;
-    float restartGameTimer = 0.f;
+class Game {
+public:
+    int     resX,                       //!<  Screen width
+            resY;                       //!<  Screen height
+
+    Vec2    playerSpawnPos;             //!<  Player spawnpos
+    float   playerRadius        = 20.f,     //!<  Player (spawn)size
+            playerMoveSpeed     = 75.f,     //!<  How much velocity the player gains by 'jumping'
+            playerMoveCooldown  = 0.1f,     //!<  How many seconds the player has to wait between each jump
+            enemyMoveSpeed      = 50.f,     //!<  How fast enemies move (this remains constant)
+            enemyMinSize        = 5.f,      //!<  Minimum enemy (spawn)size
+            enemyMaxSize        = 15.f;     //!<  Maximum enemy (spawn)size
+    int     enemyCount          = 100;      //!<  How many enemies there are
+
+    int                     player;                 //!<  Index of the player
+    World                   world;                  //!<  The circles (including the player) and lines
+    long long               stepAllocations = 0;    //!<  How many allocations the physics steps have made in total
 
-    // Gameloop
-    while (window.isOpen())
-    {
-        sf::Event event;
-        while (window.pollEvent(event))
-        {
-            if (event.type == sf::Event::Closed)
-                window.close();
+    /**
+     * Constructor.
+     *
+     * @param width - Width of the screen.
+     * @param height - Height of the screen.
+     * @param seed - Seed for the psuedo-random number generator.
+     * @param enemies - How many enemies there are.
+     */
+    Game (int width, int height, unsigned int seed, int enemies = 100) : world(width, height), gen(seed), dist(0, 1) {
+        resX        = width;
+        resY        = height;
+        enemyCount  = enemies;
+
+        // Make line(s)
+        world.lines.push_back(Line (Vec2(0, resY/4), pi/4.f-pi/2.f));
+
+        // Make player disk
+        playerSpawnPos                      = Vec2 (resX/16, resY/16);
+        player                              = world.circles.add (playerSpawnPos, Vec2(0,0), playerRadius);
+        world.circles.color[player]               = sf::Color::Red;
+        world.circles.collidesWithLines[player]   = false;
+
+        // Make other disks
+        for (int i=1; i<enemyCount+1; i++) {
+            // Shoot disk out at a random angle between 135 and 225 degrees
+            float angle = dist(gen) * pi * 2.f;
+            world.circles.add (Vec2 ( dist(gen)*resX , dist(gen)*resY ),
+                         Vec2 ( cos(angle)*enemyMoveSpeed , sin(angle)*enemyMoveSpeed ),
+                         dist(gen) * (enemyMaxSize - enemyMinSize) + enemyMinSize );
         }
+    }
 
-        // Clear window
-        window.clear();
-
+    /**
+     * Advances the game.
+     *
+     * @param dt - How much time passed since last tick.
+     * @param mouseHeld - Whether or not the left mousebutton is held.
+     * @param mousePos - Position of the mouse.
+     */
+    void tick (float dt, bool mouseHeld, Vec2 mousePos) {
         // Timers
-        float dt        = clock.restart().asSeconds();
         time            += dt;
         playerMoveTimer -= dt;
 
         // Player movement
-        if ( player->alive && playerMoveTimer <= 0 && sf::Mouse::isButtonPressed( sf::Mouse::Button::Left ) ) {
+        if ( world.circles.alive[player] && playerMoveTimer <= 0 && mouseHeld ) {
             playerMoveTimer = playerMoveCooldown;
 
             // Boost player away from mouse
-            Vec2 moveDir = ( player->pos - Vec2(sf::Mouse::getPosition(window)) ).norm();
-            player->vel += moveDir * playerMoveSpeed;
+            Vec2 moveDir = ( world.circles.pos[player] - mousePos ).norm();
+            world.circles.vel[player] += moveDir * playerMoveSpeed;
 
             // Spawn blob and decrease mass if player is big enough
-            if ( player->rad > 2.f ) {
-                float blobArea  = getArea (player->rad) / 10.f;
+            if ( world.circles.rad[player] > 2.f ) {
+                float blobArea  = getArea (world.circles.rad[player]) / 10.f;
                 float blobRad   = getRad (blobArea);
-                Circle* blob    = new Circle (player->pos - moveDir * (blobRad + player->rad + 1), moveDir * -playerMoveSpeed, blobRad);
-                circles.push_back(blob);
+                world.circles.add (world.circles.pos[player] - moveDir * (blobRad + world.circles.rad[player] + 1), moveDir * -playerMoveSpeed, blobRad);
 
-                player->rad = getRad( getArea( player->rad ) - blobArea );
+                world.circles.rad[player] = getRad( getArea( world.circles.rad[player] ) - blobArea );
             }
         }
 
         // Player deceleration
-        player->vel -= player->vel * dt / 4.f;
+        world.circles.vel[player] -= world.circles.vel[player] * dt / 4.f;
 
-        // Update and draw
-        float totalArea = 0.f;
-        for (int i=0; i<circles.size(); i++) {
-            if ( circles[i]->alive ) {
-                totalArea += getArea( circles[i]->rad );
-                circles[i]->update(dt, lines, circles, resX, resY);
-                circles[i]->draw(&window);
-            }
-        }
-
-        for (int i=0; i<lines.size(); i++) {
-            lines[i]->draw(&window);
-        }
+        // Update
+        long long   allocationsBefore = allocationCount;
+        float       totalArea         = world.step(dt);
+        stepAllocations += allocationCount - allocationsBefore;
 
         // Win/Loss
-        if ( getArea ( player->rad ) / totalArea >= 0.8f || !player->alive || time >= 120.f) {
+        if ( getArea ( world.circles.rad[player] ) / totalArea >= 0.8f || !world.circles.alive[player] || time >= 120.f) {
             time = 0.f;
             restartGameTimer += dt;
         }
@@ -556,61 +801,269 @@ int main()
 
             // Suck up all circles into one
             int livingCircles = 0;
-            int winnerIndex = -1;
-            for (int i=0; i<circles.size(); i++) {
-                Circle* circle = circles[i];
-
-                if (circle->alive) {
+            for (int i=0; i<world.circles.size(); i++) {
+                if (world.circles.alive[i]) {
                     livingCircles +=1;
-                    winnerIndex = i;
-                    circle->vel += (Vec2(resX/2, resY/2) - circle->pos).norm() * restartGameTimer * 0.3f;
+                    world.circles.vel[i] += (Vec2(resX/2, resY/2) - world.circles.pos[i]).norm() * restartGameTimer * 0.3f;
                 }
             }
 
             // Restart game when only one circle is left
             if (livingCircles == 1) {
                 restartGameTimer = 0;
-                Circle* winner = circles[winnerIndex];
 
-                // Delete old circles (except winner)
-                for (int i=0; i<circles.size(); i++) {
-                    if ( i != winnerIndex ) {
-                        delete circles[i];
-                    }
-                }
-
-                // Clear old circle-vector
-                circles.clear();
-                circles.push_back(winner);
-                winner->vel = winner->vel.norm() * enemyMoveSpeed;
+                // Clear old world.circles. The winner becomes the player and takes the first slot
+                world.circles.clear();
+                player = world.circles.add (playerSpawnPos, Vec2(0,0), playerRadius);
 
                 // Make new circles
-                winner->rad = enemyMaxSize;
                 for (int i=0; i<enemyCount; i++) {
                     Vec2    newCirclePos (resX/2 + resX/3 * (dist(gen) - 0.5f),
                                           resY/2 + resY/3 * (dist(gen) - 0.5f));
                     Vec2    newCircleDir (newCirclePos - Vec2 (resX/2, resY/2));
-                    Circle* newCircle = new Circle (newCirclePos,
-                                                    newCircleDir.norm() * enemyMoveSpeed,
-                                                    dist(gen) * (enemyMaxSize - enemyMinSize) + enemyMinSize );
-                    circles.push_back(newCircle);
+                    world.circles.add (newCirclePos,
+                                 newCircleDir.norm() * enemyMoveSpeed,
+                                 dist(gen) * (enemyMaxSize - enemyMinSize) + enemyMinSize );
                 }
 
+                // ...And give it the player's looks and properties
+                world.circles.color[player]               = sf::Color(255,0,0);
+                world.circles.collidesWithLines[player]   = false;
+            }
+        }
+    }
 
-                // Make one of the circles the 'player' if the player is dead
-                if (player == nullptr || !player->alive) {
-                    player = circles[0];
-                }
+    /**
+     * Draws the game.
+     *
+     * @param window - Pointer to the window which to draw the game onto.
+     */
+    void draw (sf::RenderWindow* window) {
+        circleBatch.clear();
+        for (int i=0; i<world.circles.size(); i++) {
+            if ( world.circles.alive[i] ) circleBatch.add(sf::Vector2f (world.circles.pos[i].x, world.circles.pos[i].y), world.circles.rad[i], world.circles.color[i]);
+        }
+        circleBatch.draw(*window);
+
+        for (int i=0; i<world.lines.size(); i++) {
+            world.lines[i].draw(window);
+        }
+    }
 
-                // ...And set all of the player's properties back
-                player->pos = playerSpawnPos;
-                player->vel = Vec2(0,0);
-                player->rad = playerRadius;
-                player->color = sf::Color(255,0,0);
-                player->collidesWithLines = false;
+    /**
+     * Gets a checksum of the game's state (FNV-1a over every circle).
+     * Two runs with the same seed and the same ticks should always have the same checksum.
+     *
+     * @return The checksum.
+     */
+    unsigned long long checksum () {
+        unsigned long long hash = 14695981039346656037ull;
+        auto mix = [&hash] (const void* data, size_t size) {
+            const unsigned char* bytes = (const unsigned char*) data;
+            for (size_t i=0; i<size; i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
             }
+        };
+
+        for (int i=0; i<world.circles.size(); i++) {
+            mix (&world.circles.pos[i],   sizeof(Vec2));
+            mix (&world.circles.vel[i],   sizeof(Vec2));
+            mix (&world.circles.rad[i],   sizeof(float));
+            mix (&world.circles.alive[i], sizeof(char));
+        }
+        return hash;
+    }
+
+    /**
+     * Gets a random number between 0 and 1 from the game's psuedo-random number generator.
+     *
+     * @return The number.
+     */
+    float random () {
+        return dist(gen);
+    }
+
+private:
+    std::mt19937                            gen;                    //!<  Psuedo-random number generator
+    std::uniform_real_distribution <float>  dist;                   //!<  Uniform distribution between 0 and 1
+    CircleBatch                             circleBatch;            //!<  Draws all of the circles at once
+    float                                   time             = 0.f, //!<  How long the current round has lasted
+                                            restartGameTimer = 0.f, //!<  How long the game has been restarting
+                                            playerMoveTimer  = 0.f; //!<  Time until the player may jump again
+};
+
+
+/**
+ * Runs the game without a window, with a fixed timestep and seed.
+ * The player 'clicks' at random positions (from the same seed), so that blobs get spawned like in a real game.
+ *
+ * @param ticks - How many ticks to run.
+ * @param seed - Seed for the psuedo-random number generator.
+ * @param threads - Threads for the parallel step, or 0 for the ordered step.
+ * @param enemies - How many enemies there are.
+ * @param dt - Length of each tick.
+ */
+void runHeadless (int ticks, unsigned int seed, int threads, int enemies, float dt) {
+    Game game (900, 900, seed, enemies);
+    game.world.setThreads(threads);
+
+    sf::Clock clock;
+    clock.restart();
+
+    for (int i=0; i<ticks; i++) {
+        Vec2 mousePos (game.random() * game.resX, game.random() * game.resY);
+        game.tick(dt, true, mousePos);
+    }
+
+    float seconds = clock.restart().asSeconds();
+
+    std::cout << "ticks:    " << ticks                  << std::endl
+              << "seed:     " << seed                   << std::endl
+              << "threads:  " << threads                << std::endl
+              << "seconds:  " << seconds                << std::endl
+              << "ticks/s:  " << ticks / seconds        << std::endl
+              << "circles:  " << game.world.circles.size()  << std::endl
+              << "step allocations/tick: " << (double) game.stepAllocations / ticks << std::endl
+              << "checksum: " << std::hex << game.checksum() << std::dec << std::endl;
+}
+
+
+/**
+ * Checks the broad-phase by stepping the same world twice, once with the spatial hash and once brute-force.
+ * After every step, their checksums have to match and every living circle has to be where the spatial hash's queries find it.
+ * Every enemy starts just below half of the finest cell size, so eating keeps pushing circles over into the next level.
+ *
+ * @param ticks - How many ticks to run.
+ * @param seed - Seed for the psuedo-random number generator.
+ * @param enemies - How many enemies there are.
+ * @param dt - Length of each tick.
+ * @return Whether or not the check passed on every tick.
+ */
+bool runBroadphaseCheck (int ticks, unsigned int seed, int enemies, float dt) {
+    Game    hashed (900, 900, seed, enemies),
+            brute  (900, 900, seed, enemies);
+
+    auto prepare = [] (Game& game, bool bruteForce) {
+        game.world.bruteForce = bruteForce;
+        for (int i=0; i<game.world.circles.size(); i++) {
+            if ( i != game.player ) game.world.circles.rad[i] = lerp(7.5f, 8.f, game.random());
+        }
+    };
+    prepare(hashed, false);
+    prepare(brute, true);
+
+    for (int i=0; i<ticks; i++) {
+        hashed.world.step(dt);
+        brute.world.step(dt);
+
+        CircleStore& circles = hashed.world.circles;
+        for (int c=0; c<circles.size(); c++) {
+            if ( circles.alive[c] && !hashed.world.grid.covers(c, circles.pos[c], circles.rad[c]) ) {
+                std::cout << "tick " << i << ": circle " << c << " (radius " << circles.rad[c] << ") is in the wrong cell of the spatial hash" << std::endl;
+                return false;
+            }
+        }
+        if ( hashed.checksum() != brute.checksum() ) {
+            std::cout << "tick " << i << ": " << std::hex << hashed.checksum() << " (spatial hash) != "
+                      << brute.checksum() << " (brute-force)" << std::dec << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "ticks:    " << ticks   << std::endl
+              << "seed:     " << seed    << std::endl
+              << "checksum: " << std::hex << hashed.checksum() << std::dec << " (spatial hash and brute-force match)" << std::endl;
+    return true;
+}
+
+
+/**
+ * Runs the micro-benchmarks without a window and prints the results as JSON (one object per line).
+ * Measures one ordered physics step of a game with the default amount of enemies.
+ */
+void runKernelBenchmark () {
+    Game game (900, 900, 1234);
+    for (int i=0; i<60; i++) game.world.step(1.f / 60.f);
+
+    int         ticks       = 2000;
+    long long   allocations = allocationCount;
+    sf::Clock   clock;
+    clock.restart();
+    for (int i=0; i<ticks; i++) game.world.step(1.f / 60.f);
+    float       seconds     = clock.restart().asSeconds();
+
+    printBenchmark ("agario", "World::step", ticks, seconds, allocationCount - allocations);
+}
+
+
+/**
+ * The main program.
+ *
+ * Usage: agario [--headless [ticks] [seed] [threads] [enemies]]
+ *        agario --check-broadphase [ticks] [seed] [enemies]
+ *        agario --render-bench [circles] [frames]
+ *        agario --bench-json
+ */
+int main(int argc, char* argv[])
+{
+    // Run without window if asked to
+    if (argc > 1 && std::string(argv[1]) == "--headless") {
+        int          ticks   = argc > 2 ? atoi(argv[2]) : 10000;
+        unsigned int seed    = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1234;
+        int          threads = argc > 4 ? atoi(argv[4]) : 0;
+        int          enemies = argc > 5 ? atoi(argv[5]) : 100;
+        runHeadless(ticks, seed, threads, enemies, 1.f / 60.f);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--check-broadphase") {
+        int          ticks   = argc > 2 ? atoi(argv[2]) : 600;
+        unsigned int seed    = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1234;
+        int          enemies = argc > 4 ? atoi(argv[4]) : 1000;
+        return runBroadphaseCheck(ticks, seed, enemies, 1.f / 60.f) ? 0 : 1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--render-bench") {
+        int circles = argc > 2 ? atoi(argv[2]) : 10000;
+        int frames  = argc > 3 ? atoi(argv[3]) : 100;
+        runRenderBenchmark(circles, frames);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-json") {
+        runKernelBenchmark();
+        return 0;
+    }
+
+    // Create window
+    int resX = 900; //!<  Screen width
+    int resY = 900; //!<  Screen height
+    sf::RenderWindow window(sf::VideoMode(resX, resY), "Agario");
+
+    // Set up game
+    std::random_device  rnddev;
+    Game                game (resX, resY, rnddev());
+
+    // Set up clock
+    sf::Clock clock;
+    clock.restart();
+
+    // Gameloop
+    while (window.isOpen())
+    {
+        sf::Event event;
+        while (window.pollEvent(event))
+        {
+            if (event.type == sf::Event::Closed)
+                window.close();
         }
 
+        // Clear window
+        window.clear();
+
+        // Update and draw
+        float dt = clock.restart().asSeconds();
+        game.tick(dt, sf::Mouse::isButtonPressed( sf::Mouse::Button::Left ), Vec2(sf::Mouse::getPosition(window)));
+        game.draw(&window);
+
         // Display window
         window.display();
     }
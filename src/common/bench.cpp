@@ -0,0 +1,31 @@
+#include "bench.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+
+std::atomic <long long> allocationCount (0);
+
+
+/**
+ * Global operator new, counting every allocation so that the benchmarks and headless modes can report them.
+ */
+void* operator new (size_t size) {
+    allocationCount++;
+    if (void* ptr = malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete (void* ptr) noexcept {
+    free(ptr);
+}
+void operator delete (void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+
+void printBenchmark (const char* program, const char* kernel, long long ops, double seconds, long long allocations) {
+    std::cout << "{\"program\": \"" << program << "\", \"kernel\": \"" << kernel << "\", \"ops\": " << ops
+              << ", \"ns_per_op\": " << seconds * 1e9 / ops
+              << ", \"allocs_per_op\": " << (double) allocations / ops << "}" << std::endl;
+}
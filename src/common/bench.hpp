@@ -0,0 +1,18 @@
+#pragma once
+
+#include <atomic>
+
+
+extern std::atomic <long long> allocationCount;    //!<  How many times operator new has been called (operator new is replaced in bench.cpp).
+
+
+/**
+ * Prints the result of a micro-benchmark as one line of JSON, so that results can be collected and compared.
+ *
+ * @param program - Name of the program.
+ * @param kernel - Name of what was measured.
+ * @param ops - How many times it ran.
+ * @param seconds - How long all runs took in total.
+ * @param allocations - How many allocations all runs made in total.
+ */
+void printBenchmark (const char* program, const char* kernel, long long ops, double seconds, long long allocations);
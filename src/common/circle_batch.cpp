@@ -0,0 +1,95 @@
+#include "circle_batch.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "math.hpp"
+
+
+CircleBatch::CircleBatch (int points) {
+    pointCount = points;
+    for (int i=0; i<=pointCount; i++) {
+        float angle = 2.f * pi * i / pointCount;
+        unitCircle.push_back( sf::Vector2f (cos(angle), sin(angle)) );
+    }
+}
+
+void CircleBatch::clear () {
+    vertexCount = 0;
+}
+
+void CircleBatch::add (sf::Vector2f pos, float rad, sf::Color color) {
+    if ( vertexCount + pointCount * 3 > vertices.getVertexCount() ) {
+        vertices.resize( std::max( vertexCount + pointCount * 3, vertices.getVertexCount() * 2 ) );
+    }
+
+    sf::Vertex*     v    = &vertices[vertexCount];
+    sf::Vector2f    prev = pos + unitCircle[0] * rad;
+
+    for (int i=1; i<=pointCount; i++) {
+        sf::Vector2f next = pos + unitCircle[i] * rad;
+        v[0] = sf::Vertex (pos,  color);
+        v[1] = sf::Vertex (prev, color);
+        v[2] = sf::Vertex (next, color);
+        v    += 3;
+        prev =  next;
+    }
+    vertexCount += pointCount * 3;
+}
+
+void CircleBatch::draw (sf::RenderWindow& window) {
+    if ( vertexCount > 0 ) window.draw(&vertices[0], vertexCount, sf::Triangles);
+}
+
+size_t CircleBatch::getVertexCount () {
+    return vertexCount;
+}
+
+
+void runRenderBenchmark (int circleCount, int frames) {
+    std::mt19937                            gen (1234);
+    std::uniform_real_distribution <float>  dist (0, 1);
+    std::vector <sf::Vector2f>              pos;
+    std::vector <float>                     rad;
+    std::vector <sf::Color>                 color;
+    for (int i=0; i<circleCount; i++) {
+        pos.push_back   ( sf::Vector2f (dist(gen)*900, dist(gen)*900) );
+        rad.push_back   ( 5.f + 10.f * dist(gen) );
+        color.push_back ( sf::Color(255,255-255*rad.back()/15.f,0) );
+    }
+
+    sf::Clock   clock;
+    double      shapeVertices = 0;
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        for (int i=0; i<circleCount; i++) {
+            sf::CircleShape     circle;
+            circle.setRadius    ( rad[i] );
+            circle.setFillColor ( color[i] );
+            circle.setOrigin    ( rad[i], rad[i] );
+            circle.setPosition  ( pos[i] );
+            shapeVertices       += circle.getPointCount() + 2;  // Drawn as a triangle fan
+        }
+    }
+    float shapeSeconds = clock.restart().asSeconds();
+
+    CircleBatch batch;
+    double      batchVertices = 0;
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        batch.clear();
+        for (int i=0; i<circleCount; i++) batch.add( pos[i], rad[i], color[i] );
+        batchVertices += batch.getVertexCount();
+    }
+    float batchSeconds = clock.restart().asSeconds();
+
+    std::cout << "circles/frame:        " << circleCount                            << std::endl
+              << "frames:               " << frames                                 << std::endl
+              << "sf::CircleShape:      " << shapeVertices / shapeSeconds           << " vertices/s, "
+                                          << circleCount * frames / shapeSeconds    << " circles/s, "
+                                          << circleCount                            << " draw calls/frame" << std::endl
+              << "CircleBatch:          " << batchVertices / batchSeconds           << " vertices/s, "
+                                          << circleCount * frames / batchSeconds    << " circles/s, "
+                                          << 1                                      << " draw call/frame" << std::endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+
+/**
+ * Draws lots of circles with a single draw call.
+ * Every circle is written as a fan of triangles into one persistent vertex array, which only ever grows.
+ */
+class CircleBatch {
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param points - How many points each circle is made of (sf::CircleShape uses 30).
+     */
+    CircleBatch (int points = 30);
+
+    /**
+     * Removes all circles from the batch.
+     */
+    void clear ();
+
+    /**
+     * Adds a circle to the batch.
+     *
+     * @param pos - Position of the circle.
+     * @param rad - Radius of the circle.
+     * @param color - Color of the circle.
+     */
+    void add (sf::Vector2f pos, float rad, sf::Color color);
+
+    /**
+     * Draws every circle in the batch.
+     *
+     * @param window - The window which to draw the circles onto.
+     */
+    void draw (sf::RenderWindow& window);
+
+    /**
+     * Gets the amount of vertices currently in the batch.
+     *
+     * @return The amount of vertices.
+     */
+    size_t getVertexCount ();
+
+private:
+    sf::VertexArray             vertices;           //!<  Vertices of every circle (only the first 'vertexCount' are in use)
+    size_t                      vertexCount = 0;    //!<  Amount of vertices in use
+    int                         pointCount;         //!<  Points per circle
+    std::vector <sf::Vector2f>  unitCircle;         //!<  Points of a circle with radius 1 (the first point is repeated at the end)
+};
+
+
+/**
+ * Measures how fast circles are turned into vertices, without a window (nothing is actually drawn).
+ * Compares building one sf::CircleShape per circle (how circles used to be drawn) with the CircleBatch.
+ *
+ * @param circleCount - How many circles each frame has.
+ * @param frames - How many frames to run.
+ */
+void runRenderBenchmark (int circleCount, int frames);
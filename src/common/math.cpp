@@ -0,0 +1,14 @@
+#include "math.hpp"
+
+
+float lerp (float f0, float f1, float t) {
+    if      (t < 0) t = 0;
+    else if (t > 1) t = 1;
+    return f0 + (f1 - f0) * t;
+}
+
+Vec2 lerp (Vec2 p0, Vec2 p1, float t) {
+    if      (t < 0) t = 0;
+    else if (t > 1) t = 1;
+    return p0 + (p1 - p0) * t;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "vec2.hpp"
+
+
+const double    pi = 2.0 * acos(0.0);   //!<  Pi.
+
+
+/**
+ * Lerps between two floats.
+ *
+ * @param f0 - Start value.
+ * @param f1 - End value.
+ * @param t  - Unclamped time.
+ */
+float lerp (float f0, float f1, float t);
+
+/**
+ * Lerps between two vectors.
+ *
+ * @param p0 - Start position.
+ * @param p1 - End position.
+ * @param t  - Unclamped time.
+ */
+Vec2 lerp (Vec2 p0, Vec2 p1, float t);
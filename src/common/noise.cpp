@@ -0,0 +1,257 @@
+#include "noise.hpp"
+
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+
+float hash11 (float p) {
+    p = p * .1031 - floor(p * .1031);
+    p *= p + 33.33;
+    p *= p + p;
+    return p - floor(p);
+}
+
+uint64_t hash64 (uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+float hash64_float (uint64_t x) {
+    return (hash64(x) >> 40) * (1.0f / 16777216.0f);
+}
+
+float noise11_octave (float p, float scale, float seed) {
+    p *= scale;
+    float   pint    = floor(p),
+            pfract  = p - pint,
+            res     = (1.0f - pfract) * hash11(pint + seed) + pfract * hash11(pint + 1.0f + seed);
+    return (res - 0.5f)*2.0f;
+}
+
+float noise11_octave_wrapped (double p, float scale, float seed) {
+    double  x       = p * scale,
+            pint    = floor(x),
+            lattice = pint - floor(pint / noisePeriod) * noisePeriod;
+    float   pfract  = x - pint,
+            l0      = lattice,
+            l1      = l0 + 1.0f >= noisePeriod ? 0.0f : l0 + 1.0f,
+            res     = (1.0f - pfract) * hash11(l0 + seed) + pfract * hash11(l1 + seed);
+    return (res - 0.5f)*2.0f;
+}
+
+
+/*
+ * The vector versions follow the scalar operations one by one, so that they round the same way.
+ * hash11 does its first two steps in double (the constants are doubles), so those are done in double lanes as well.
+ * Every build profile turns off FMA contraction, which would otherwise round differently in either version.
+ */
+#if defined(__AVX__)
+
+/**
+ * hash11 for 8 inputs.
+ */
+static __m256 hash11_8 (__m256 p) {
+    __m256d lo = _mm256_cvtps_pd (_mm256_castps256_ps128 (p)),
+            hi = _mm256_cvtps_pd (_mm256_extractf128_ps (p, 1));
+
+    lo = _mm256_mul_pd (lo, _mm256_set1_pd (.1031));
+    hi = _mm256_mul_pd (hi, _mm256_set1_pd (.1031));
+    lo = _mm256_sub_pd (lo, _mm256_floor_pd (lo));
+    hi = _mm256_sub_pd (hi, _mm256_floor_pd (hi));
+
+    // Round to float like the scalar assignment does, then back to double for the next step
+    lo = _mm256_cvtps_pd (_mm256_cvtpd_ps (lo));
+    hi = _mm256_cvtps_pd (_mm256_cvtpd_ps (hi));
+    lo = _mm256_mul_pd (lo, _mm256_add_pd (lo, _mm256_set1_pd (33.33)));
+    hi = _mm256_mul_pd (hi, _mm256_add_pd (hi, _mm256_set1_pd (33.33)));
+
+    __m256 x = _mm256_set_m128 (_mm256_cvtpd_ps (hi), _mm256_cvtpd_ps (lo));
+    x = _mm256_mul_ps (x, _mm256_add_ps (x, x));
+    return _mm256_sub_ps (x, _mm256_floor_ps (x));
+}
+
+void noise11_octave_batch (float minp, float maxp, int count, float scale, float seed, float* out) {
+    __m256  range   = _mm256_set1_ps (maxp - minp),
+            start   = _mm256_set1_ps (minp),
+            n       = _mm256_set1_ps ((float) count),
+            scaleV  = _mm256_set1_ps (scale),
+            seedV   = _mm256_set1_ps (seed),
+            one     = _mm256_set1_ps (1.0f),
+            half    = _mm256_set1_ps (0.5f),
+            two     = _mm256_set1_ps (2.0f);
+
+    int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m256  index   = _mm256_cvtepi32_ps (_mm256_setr_epi32 (i, i+1, i+2, i+3, i+4, i+5, i+6, i+7)),
+                p       = _mm256_add_ps (_mm256_div_ps (_mm256_mul_ps (range, index), n), start);
+
+        p = _mm256_mul_ps (p, scaleV);
+        __m256  pint    = _mm256_floor_ps (p),
+                pfract  = _mm256_sub_ps (p, pint),
+                h0      = hash11_8 (_mm256_add_ps (pint, seedV)),
+                h1      = hash11_8 (_mm256_add_ps (_mm256_add_ps (pint, one), seedV)),
+                res     = _mm256_add_ps (_mm256_mul_ps (_mm256_sub_ps (one, pfract), h0), _mm256_mul_ps (pfract, h1));
+
+        _mm256_storeu_ps (out + i, _mm256_mul_ps (_mm256_sub_ps (res, half), two));
+    }
+
+    for (; i<count; i++) out[i] = noise11_octave ((maxp-minp)*(float)i/(float)count + minp, scale, seed);
+}
+
+/**
+ * Splits 4 scaled inputs into the fractions and the wrapped lattice points on either side, like noise11_octave_wrapped.
+ */
+static void splitWrapped_4 (__m256d x, __m128& pfract, __m128& l0, __m128& l1) {
+    __m256d period  = _mm256_set1_pd (noisePeriod),
+            pint    = _mm256_floor_pd (x),
+            lattice = _mm256_sub_pd (pint, _mm256_mul_pd (_mm256_floor_pd (_mm256_div_pd (pint, period)), period));
+
+    pfract  = _mm256_cvtpd_ps (_mm256_sub_pd (x, pint));
+    l0      = _mm256_cvtpd_ps (lattice);
+    l1      = _mm_add_ps (l0, _mm_set1_ps (1.0f));
+    l1      = _mm_andnot_ps (_mm_cmpge_ps (l1, _mm_set1_ps ((float) noisePeriod)), l1);
+}
+
+void noise11_octave_wrapped_batch (double minp, double maxp, int count, float scale, float seed, float* out) {
+    __m256d range   = _mm256_set1_pd (maxp - minp),
+            start   = _mm256_set1_pd (minp),
+            n       = _mm256_set1_pd ((double) count),
+            scaleD  = _mm256_set1_pd (scale);
+    __m256  seedV   = _mm256_set1_ps (seed),
+            one     = _mm256_set1_ps (1.0f),
+            half    = _mm256_set1_ps (0.5f),
+            two     = _mm256_set1_ps (2.0f);
+
+    int i = 0;
+    for (; i+8<=count; i+=8) {
+        __m256d xlo = _mm256_mul_pd (_mm256_add_pd (_mm256_div_pd (_mm256_mul_pd (range, _mm256_cvtepi32_pd (_mm_setr_epi32 (i,   i+1, i+2, i+3))), n), start), scaleD),
+                xhi = _mm256_mul_pd (_mm256_add_pd (_mm256_div_pd (_mm256_mul_pd (range, _mm256_cvtepi32_pd (_mm_setr_epi32 (i+4, i+5, i+6, i+7))), n), start), scaleD);
+
+        __m128  fractLo, fractHi, l0Lo, l0Hi, l1Lo, l1Hi;
+        splitWrapped_4 (xlo, fractLo, l0Lo, l1Lo);
+        splitWrapped_4 (xhi, fractHi, l0Hi, l1Hi);
+
+        __m256  pfract  = _mm256_set_m128 (fractHi, fractLo),
+                h0      = hash11_8 (_mm256_add_ps (_mm256_set_m128 (l0Hi, l0Lo), seedV)),
+                h1      = hash11_8 (_mm256_add_ps (_mm256_set_m128 (l1Hi, l1Lo), seedV)),
+                res     = _mm256_add_ps (_mm256_mul_ps (_mm256_sub_ps (one, pfract), h0), _mm256_mul_ps (pfract, h1));
+
+        _mm256_storeu_ps (out + i, _mm256_mul_ps (_mm256_sub_ps (res, half), two));
+    }
+
+    for (; i<count; i++) out[i] = noise11_octave_wrapped ((maxp-minp)*i/count + minp, scale, seed);
+}
+
+#elif defined(__SSE4_1__)
+
+/**
+ * hash11 for 4 inputs.
+ */
+static __m128 hash11_4 (__m128 p) {
+    __m128d lo = _mm_cvtps_pd (p),
+            hi = _mm_cvtps_pd (_mm_movehl_ps (p, p));
+
+    lo = _mm_mul_pd (lo, _mm_set1_pd (.1031));
+    hi = _mm_mul_pd (hi, _mm_set1_pd (.1031));
+    lo = _mm_sub_pd (lo, _mm_floor_pd (lo));
+    hi = _mm_sub_pd (hi, _mm_floor_pd (hi));
+
+    // Round to float like the scalar assignment does, then back to double for the next step
+    lo = _mm_cvtps_pd (_mm_cvtpd_ps (lo));
+    hi = _mm_cvtps_pd (_mm_cvtpd_ps (hi));
+    lo = _mm_mul_pd (lo, _mm_add_pd (lo, _mm_set1_pd (33.33)));
+    hi = _mm_mul_pd (hi, _mm_add_pd (hi, _mm_set1_pd (33.33)));
+
+    __m128 x = _mm_movelh_ps (_mm_cvtpd_ps (lo), _mm_cvtpd_ps (hi));
+    x = _mm_mul_ps (x, _mm_add_ps (x, x));
+    return _mm_sub_ps (x, _mm_floor_ps (x));
+}
+
+void noise11_octave_batch (float minp, float maxp, int count, float scale, float seed, float* out) {
+    __m128  range   = _mm_set1_ps (maxp - minp),
+            start   = _mm_set1_ps (minp),
+            n       = _mm_set1_ps ((float) count),
+            scaleV  = _mm_set1_ps (scale),
+            seedV   = _mm_set1_ps (seed),
+            one     = _mm_set1_ps (1.0f),
+            half    = _mm_set1_ps (0.5f),
+            two     = _mm_set1_ps (2.0f);
+
+    int i = 0;
+    for (; i+4<=count; i+=4) {
+        __m128  index   = _mm_cvtepi32_ps (_mm_setr_epi32 (i, i+1, i+2, i+3)),
+                p       = _mm_add_ps (_mm_div_ps (_mm_mul_ps (range, index), n), start);
+
+        p = _mm_mul_ps (p, scaleV);
+        __m128  pint    = _mm_floor_ps (p),
+                pfract  = _mm_sub_ps (p, pint),
+                h0      = hash11_4 (_mm_add_ps (pint, seedV)),
+                h1      = hash11_4 (_mm_add_ps (_mm_add_ps (pint, one), seedV)),
+                res     = _mm_add_ps (_mm_mul_ps (_mm_sub_ps (one, pfract), h0), _mm_mul_ps (pfract, h1));
+
+        _mm_storeu_ps (out + i, _mm_mul_ps (_mm_sub_ps (res, half), two));
+    }
+
+    for (; i<count; i++) out[i] = noise11_octave ((maxp-minp)*(float)i/(float)count + minp, scale, seed);
+}
+
+/**
+ * Splits 2 scaled inputs into the fractions and the wrapped lattice points on either side, like noise11_octave_wrapped.
+ * The results are in the lower 2 lanes.
+ */
+static void splitWrapped_2 (__m128d x, __m128& pfract, __m128& l0, __m128& l1) {
+    __m128d period  = _mm_set1_pd (noisePeriod),
+            pint    = _mm_floor_pd (x),
+            lattice = _mm_sub_pd (pint, _mm_mul_pd (_mm_floor_pd (_mm_div_pd (pint, period)), period));
+
+    pfract  = _mm_cvtpd_ps (_mm_sub_pd (x, pint));
+    l0      = _mm_cvtpd_ps (lattice);
+    l1      = _mm_add_ps (l0, _mm_set1_ps (1.0f));
+    l1      = _mm_andnot_ps (_mm_cmpge_ps (l1, _mm_set1_ps ((float) noisePeriod)), l1);
+}
+
+void noise11_octave_wrapped_batch (double minp, double maxp, int count, float scale, float seed, float* out) {
+    __m128d range   = _mm_set1_pd (maxp - minp),
+            start   = _mm_set1_pd (minp),
+            n       = _mm_set1_pd ((double) count),
+            scaleD  = _mm_set1_pd (scale);
+    __m128  seedV   = _mm_set1_ps (seed),
+            one     = _mm_set1_ps (1.0f),
+            half    = _mm_set1_ps (0.5f),
+            two     = _mm_set1_ps (2.0f);
+
+    int i = 0;
+    for (; i+4<=count; i+=4) {
+        __m128d xlo = _mm_mul_pd (_mm_add_pd (_mm_div_pd (_mm_mul_pd (range, _mm_cvtepi32_pd (_mm_setr_epi32 (i,   i+1, 0, 0))), n), start), scaleD),
+                xhi = _mm_mul_pd (_mm_add_pd (_mm_div_pd (_mm_mul_pd (range, _mm_cvtepi32_pd (_mm_setr_epi32 (i+2, i+3, 0, 0))), n), start), scaleD);
+
+        __m128  fractLo, fractHi, l0Lo, l0Hi, l1Lo, l1Hi;
+        splitWrapped_2 (xlo, fractLo, l0Lo, l1Lo);
+        splitWrapped_2 (xhi, fractHi, l0Hi, l1Hi);
+
+        __m128  pfract  = _mm_movelh_ps (fractLo, fractHi),
+                h0      = hash11_4 (_mm_add_ps (_mm_movelh_ps (l0Lo, l0Hi), seedV)),
+                h1      = hash11_4 (_mm_add_ps (_mm_movelh_ps (l1Lo, l1Hi), seedV)),
+                res     = _mm_add_ps (_mm_mul_ps (_mm_sub_ps (one, pfract), h0), _mm_mul_ps (pfract, h1));
+
+        _mm_storeu_ps (out + i, _mm_mul_ps (_mm_sub_ps (res, half), two));
+    }
+
+    for (; i<count; i++) out[i] = noise11_octave_wrapped ((maxp-minp)*i/count + minp, scale, seed);
+}
+
+#else
+
+void noise11_octave_batch (float minp, float maxp, int count, float scale, float seed, float* out) {
+    for (int i=0; i<count; i++) out[i] = noise11_octave ((maxp-minp)*(float)i/(float)count + minp, scale, seed);
+}
+
+void noise11_octave_wrapped_batch (double minp, double maxp, int count, float scale, float seed, float* out) {
+    for (int i=0; i<count; i++) out[i] = noise11_octave_wrapped ((maxp-minp)*i/count + minp, scale, seed);
+}
+
+#endif
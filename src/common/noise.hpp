@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+
+const double    noisePeriod = 1 << 20;  //!<  Lattice points after which noise11_octave_wrapped repeats.
+
+/**
+ * Hash function
+ *
+ * @param p - Input.
+ * @return Seemingly unrelated output between 0 and 1.
+ */
+float hash11 (float p);
+
+/**
+ * Integer hash (the splitmix64 finalizer). Every input bit affects every output bit, and no two inputs give the same
+ * output, so neighbouring seeds give unrelated results.
+ *
+ * @param x - Input.
+ * @return Seemingly unrelated output.
+ */
+uint64_t hash64 (uint64_t x);
+
+/**
+ * hash64, as a float.
+ *
+ * @param x - Input.
+ * @return Seemingly unrelated output between 0 and 1 (not including 1).
+ */
+float hash64_float (uint64_t x);
+
+/**
+ * One octave of value noise: hashes at whole numbers, linearly interpolated in between.
+ *
+ * @param p - Input.
+ * @param scale - How many whole numbers (hashes) there are per unit of 'p'.
+ * @param seed - Seed, added to every hashed number.
+ * @return Noise between -1 and 1.
+ */
+float noise11_octave (float p, float scale, float seed);
+
+/**
+ * Samples noise11_octave at 'count' evenly spaced inputs in one call, using SSE4.1 or AVX when the build enables
+ * them (and plain noise11_octave otherwise). Input i is (maxp-minp)*i/count + minp, and every output is
+ * bit-identical to calling noise11_octave on that input.
+ *
+ * @param minp - First input.
+ * @param maxp - End of the inputs (not included).
+ * @param count - How many samples to take.
+ * @param scale - See noise11_octave.
+ * @param seed - See noise11_octave.
+ * @param out - Array of at least 'count' floats which is filled with the samples.
+ */
+void noise11_octave_batch (float minp, float maxp, int count, float scale, float seed, float* out);
+
+/**
+ * noise11_octave for inputs anywhere on the line. The input is scaled in double and its whole-number lattice point is
+ * wrapped to [0, noisePeriod) before it is hashed, so the noise is just as detailed far away from 0 as close to it
+ * (noise11_octave runs out of float precision as the input grows). Repeats every noisePeriod / scale inputs.
+ *
+ * @param p - Input.
+ * @param scale - See noise11_octave.
+ * @param seed - See noise11_octave.
+ * @return Noise between -1 and 1.
+ */
+float noise11_octave_wrapped (double p, float scale, float seed);
+
+/**
+ * Samples noise11_octave_wrapped at 'count' evenly spaced inputs in one call, like noise11_octave_batch does for
+ * noise11_octave. Input i is (maxp-minp)*i/count + minp, worked out in double, and every output is bit-identical to
+ * calling noise11_octave_wrapped on that input.
+ *
+ * @param minp - First input.
+ * @param maxp - End of the inputs (not included).
+ * @param count - How many samples to take.
+ * @param scale - See noise11_octave.
+ * @param seed - See noise11_octave.
+ * @param out - Array of at least 'count' floats which is filled with the samples.
+ */
+void noise11_octave_wrapped_batch (double minp, double maxp, int count, float scale, float seed, float* out);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * A small pool of worker threads which run a job over a range of chunks.
+ * The calling thread helps out, so a pool of 1 thread has no workers at all.
+ */
+class ThreadPool {
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param threadCount - How many threads (including the caller) run jobs.
+     */
+    ThreadPool (int threadCount) {
+        for (int i=1; i<threadCount; i++) {
+            workers.emplace_back([this] () { workerLoop(); });
+        }
+    }
+
+    /**
+     * Destructor.
+     */
+    ~ThreadPool () {
+        {
+            std::lock_guard <std::mutex> lock (mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (int i=0; i<workers.size(); i++) workers[i].join();
+    }
+
+    /**
+     * Gets the amount of threads (including the caller) that run jobs.
+     *
+     * @return The amount of threads.
+     */
+    int size () {
+        return workers.size() + 1;
+    }
+
+    /**
+     * Runs job(chunk) for every chunk in [0, chunkCount) and waits until all are done.
+     * Which thread gets which chunk varies, so jobs should only write to what belongs to their chunk.
+     *
+     * @param chunkCount - How many chunks there are.
+     * @param job - The job, callable as job(int chunk).
+     */
+    template <typename Job>
+    void run (int chunkCount, Job& job) {
+        {
+            std::lock_guard <std::mutex> lock (mutex);
+            jobContext  = &job;
+            jobFunction = [] (void* context, int chunk) { (*(Job*) context)(chunk); };
+            chunks      = chunkCount;
+            nextChunk   = 0;
+            pending     = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        work();
+
+        std::unique_lock <std::mutex> lock (mutex);
+        done.wait(lock, [this] () { return pending == 0; });
+    }
+
+private:
+    std::vector <std::thread>   workers;                //!<  Worker threads
+    std::mutex                  mutex;                  //!<  Guards everything below
+    std::condition_variable     wake,                   //!<  Wakes workers when there's a new job
+                                done;                   //!<  Wakes the caller when all workers are done
+    void                        (*jobFunction)(void*, int) = nullptr;   //!<  Calls the job
+    void*                       jobContext  = nullptr;  //!<  The job
+    int                         chunks      = 0,        //!<  Amount of chunks in the job
+                                pending     = 0,        //!<  Workers that haven't finished the job yet
+                                generation  = 0;        //!<  Increased for every job
+    std::atomic <int>           nextChunk   {0};        //!<  Next chunk to be taken
+    bool                        stopping    = false;    //!<  Whether or not the workers should stop
+
+    /**
+     * Takes and runs chunks until there are none left.
+     */
+    void work () {
+        for (int chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+            jobFunction(jobContext, chunk);
+        }
+    }
+
+    /**
+     * What every worker thread does: wait for a job, help with it, repeat.
+     */
+    void workerLoop () {
+        int seenGeneration = 0;
+        while (true) {
+            {
+                std::unique_lock <std::mutex> lock (mutex);
+                wake.wait(lock, [&] () { return stopping || generation != seenGeneration; });
+                if (stopping) return;
+                seenGeneration = generation;
+            }
+
+            work();
+
+            std::lock_guard <std::mutex> lock (mutex);
+            if (--pending == 0) done.notify_one();
+        }
+    }
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <cmath>
+#include <iostream>
+
+
+/**
+ * A class for simple 2D vectors.
+ */
+class Vec2 {
+public:
+    float   x,  //!<  x-position (width)
+            y;  //!<  y-position (height)
+
+    /**
+     * Standard constructor.
+     */
+    Vec2 () {};
+
+    /**
+     * Constructor.
+     */
+    Vec2 (float xpos, float ypos) {
+        x = xpos;
+        y = ypos;
+    }
+
+    /**
+     * sf::Vector2f copy constructor.
+     */
+    Vec2 (sf::Vector2f vec) {
+        x = vec.x;
+        y = vec.y;
+    }
+
+    /**
+     * sf::Vector2i copy constructor.
+     */
+    Vec2 (sf::Vector2i vec) {
+        x = (float) vec.x;
+        y = (float) vec.y;
+    }
+
+    /**
+     * Cout
+     */
+    friend std::ostream& operator<< (std::ostream& os, const Vec2 vec) {
+        os << "(" << vec.x << ", " << vec.y << ")";
+        return os;
+    }
+
+    /**
+     * Addition by another Vec2.
+     *
+     * @param vec - The vector to add.
+     * @return This vector, added with 'vec'.
+     */
+    Vec2 operator+= (Vec2 vec) {
+        x += vec.x;
+        y += vec.y;
+        return (*this);
+    }
+    Vec2 operator+ (Vec2 vec) {
+        Vec2 ret;
+        ret.x = x + vec.x;
+        ret.y = y + vec.y;
+        return ret;
+    }
+
+    /**
+     * Subtraction by another Vec2.
+     *
+     * @param vec - The vector to subtract.
+     * @return This vector, subtracted by 'vec'.
+     */
+    Vec2 operator-= (Vec2 vec) {
+        x -= vec.x;
+        y -= vec.y;
+        return (*this);
+    }
+    Vec2 operator- (Vec2 vec) {
+        Vec2 ret;
+        ret.x = x - vec.x;
+        ret.y = y - vec.y;
+        return ret;
+    }
+
+    /**
+     * Division by number.
+     *
+     * @param num - The number to divide by.
+     * @return This vector, divided by 'num'.
+     */
+    Vec2 operator/= (float num) {
+        x /= num;
+        y /= num;
+        return (*this);
+    }
+    Vec2 operator/ (float n) {
+        Vec2 ret;
+        ret.x = x / n;
+        ret.y = y / n;
+        return ret;
+    }
+
+    /**
+     * Multiplication by number.
+     *
+     * @param num - The number to multiplicate by.
+     * @return This vector, multiplied by 'num'.
+     */
+    Vec2 operator*= (float num) {
+        x *= num;
+        y *= num;
+        return (*this);
+    }
+    Vec2 operator* (float n) {
+        Vec2 ret;
+        ret.x = x * n;
+        ret.y = y * n;
+        return ret;
+    }
+    friend Vec2 operator* (float n, Vec2 u) {
+        return u * n;
+    }
+
+    /**
+     * Dot product.
+     *
+     * @param vec - The vector to dot with.
+     * @return The dot product between this and 'vec'.
+     */
+    float operator* (Vec2 vec) {
+        return x*vec.x + y*vec.y;
+    }
+
+    /**
+     * Length.
+     *
+     * @return The length of this vector.
+     */
+    float len () {
+        return sqrt(pow(x,2) + pow(y,2));
+    }
+
+    /**
+     * Distance.
+     *
+     * @param vec - The other vector.
+     * @return Distance between this vector and the other.
+     */
+    float dist(Vec2 vec) {
+        return ((*this) - vec).len();
+    }
+
+    /**
+     * Normalization.
+     *
+     * @return A new Vec2 that is this, normalized.
+     */
+    Vec2 norm () {
+        return (*this) / (*this).len();
+    }
+
+    /**
+     * Projection.
+     *
+     * @param vec - The vector that is projected onto this.
+     * @return A new Vec2 that is 'vec' projected onto this.
+     */
+    Vec2 proj (Vec2 vec) {
+        return (*this) * ((*this)*vec / pow((*this).len(), 2));
+    }
+
+    /**
+     * Reflection.
+     *
+     * @param vec - A vector.
+     * @return A new Vec2 that is 'vec' reflected about this.
+     */
+    Vec2 refl (Vec2 vec) {
+        return (*this).proj(vec) * 2 - vec;
+    }
+
+    /**
+     * Orthagonal.
+     *
+     * @return A new Vec2 which is orthagonal to this.
+     */
+    Vec2 orth () {
+        return Vec2 (-y, x);
+    }
+
+    /**
+     * Rotation.
+     *
+     * @param angle - Angle to rotate with.
+     * @return A new Vec2 which is this rotated 'angle' around origo.
+     */
+    Vec2 rot (float angle) {
+        return Vec2 ( cos(angle) * x - sin(angle) * y,
+                      sin(angle) * x + cos(angle) * y );
+    }
+};
@@ -1,10 +1,21 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <random>
 #include <stdlib.h>
 
-const double pi = 2.0 * acos(0.0);
+#include "common/bench.hpp"
+#include "common/math.hpp"
+#include "common/noise.hpp"
+
 float   windowx = 800,
         windowy = 800;
 
@@ -12,18 +23,27 @@ std::random_device  rnddev;
 std::mt19937        gen(rnddev( ));
 std::uniform_real_distribution <float> dist(0, 1);
 
-
-float* generateHalfWayPoints2 ( float startValue, float endValue, int generations, float alpha, float beta ) {
+/**
+ * Midpoint displacement between two values, with random displacements.
+ * Works in place on the caller's buffer, so that it can be reused without allocating.
+ *
+ * @param ret - Buffer of at least 2^generations + 1 floats, which is filled with the points (including both ends).
+ * @param startValue - Value of the first point.
+ * @param endValue - Value of the last point.
+ * @param generations - How many times the points are split in half.
+ * @param alpha - How "smooth" the outputs are.
+ * @param beta - How high/low the tops and bottoms can be.
+ */
+void generateHalfWayPoints2 ( float* ret, float startValue, float endValue, int generations, float alpha, float beta ) {
     int startIndex  = 0,
-        endIndex    = pow(2, generations);
+        endIndex    = 1 << generations;
 
-    float* ret = new float[endIndex];
     ret[startIndex] = startValue;
     ret[endIndex]   = endValue;
 
     for (int i=1; i<generations+1; i++){
-        int     stepSize    = pow(2, generations - i);
-        int     stepAmount  = pow(2, i);
+        int     stepSize    = 1 << (generations - i);
+        int     stepAmount  = 1 << i;
         beta *= pow(2, -alpha);
 
         for (int j=0; j<stepAmount; j+=2) {
@@ -31,8 +51,6 @@ float* generateHalfWayPoints2 ( float startValue, float endValue, int generation
             ret[(j+1)*stepSize] = ( ret[j*stepSize] + ret[(j+2)*stepSize] ) / 2.f + displacement;
         }
     }
-
-    return ret;
 }
 
 std::vector <sf::Vector2f> heightmapToVector ( float* heightmap, int heightmapSize ) {
@@ -81,26 +99,6 @@ void drawMountains ( std::vector <sf::Vector2f> points, sf::RenderWindow& window
     window.draw( &triangleVertex[0], triangleVertex.size(), sf::Triangles );
 }
 
-float hash11(float p)
-{
-    p = p * .1031 - floor(p * .1031);
-    p *= p + 33.33;
-    p *= p + p;
-    return p - floor(p);
-}
-
-float noise11_octave(float p, float scale, float seed) {
-  p *= scale;
-  float     pint = floor(p),
-            pfract = p - pint,
-            res = (1.0f - pfract) * hash11(pint + seed) + pfract * hash11(pint + 1.0f + seed);
-  return (res - 0.5f)*2.0f;
-}
-
-float lerp ( float f0, float f1, float t ) {
-    return (1.f-t)*f0 + t*f1;
-}
-
 sf::Vector2f lerp ( sf::Vector2f p0, sf::Vector2f p1, float t ) {
     return p0*(1.f-t) + p1*t;
 }
@@ -119,8 +117,518 @@ void drawCircle ( sf::Vector2f position, float radius, sf::RenderWindow& window,
 }
 
 
-int main()
+/**
+ * How a noise layer is combined with the layers below it.
+ */
+enum BlendMode {
+    Add,        //!<  The layer is added on top
+    Average     //!<  The result is the average of the layer and what is below it
+};
+
+
+/**
+ * Parameters of one layer (octave) of noise.
+ */
+struct NoiseLayer {
+    float       scale,      //!<  Frequency (see noise11_octave)
+                amplitude,  //!<  Height of the noise
+                seed;       //!<  Seed (see noise11_octave)
+    BlendMode   blend;      //!<  How the layer is combined with the ones below it (the first layer is always taken as is)
+};
+
+
+/**
+ * Terrain made of layers of noise, evaluated as fractal Brownian motion.
+ * Every layer is kept, so the terrain can be sampled again over any range and at any resolution.
+ * The samples of each layer, and the combined heights up to each layer, are cached and only recomputed from the first
+ * layer that changed.
+ */
+class Terrain {
+public:
+
+    /**
+     * Adds a layer on top of the others.
+     *
+     * @param layer - The layer.
+     */
+    void addLayer (NoiseLayer layer) {
+        layers.push_back (layer);
+        layerNoise.emplace_back ();
+        layerHeights.emplace_back ();
+        markDirty (layers.size() - 1);
+    }
+
+    /**
+     * Changes a layer.
+     *
+     * @param index - Index of the layer.
+     * @param layer - The new parameters of the layer.
+     */
+    void setLayer (int index, NoiseLayer layer) {
+        layers[index] = layer;
+        markDirty (index);
+    }
+
+    /**
+     * Gets a layer.
+     *
+     * @param index - Index of the layer.
+     * @return The layer.
+     */
+    NoiseLayer getLayer (int index) {
+        return layers[index];
+    }
+
+    /**
+     * Gets the amount of layers.
+     *
+     * @return The amount of layers.
+     */
+    int getLayerCount () {
+        return layers.size();
+    }
+
+    /**
+     * Sets which inputs the terrain is sampled at (see noise11_octave_wrapped_batch). Changing it invalidates every layer.
+     *
+     * @param minp - First input.
+     * @param maxp - End of the inputs (not included).
+     * @param count - How many samples to take.
+     */
+    void setRange (double minp, double maxp, int count) {
+        if ( minp == rangeMin && maxp == rangeMax && count == sampleCount ) return;
+        rangeMin    = minp;
+        rangeMax    = maxp;
+        sampleCount = count;
+        markDirty (0);
+    }
+
+    /**
+     * Gets the heights of the terrain at every sample, recomputing only the layers which changed.
+     *
+     * @return The heights (empty if there are no layers).
+     */
+    const std::vector <float>& getHeights () {
+        static const std::vector <float> none;
+        if ( layers.empty() ) return none;
+
+        for (int k=firstDirty; k<layers.size(); k++) {
+            NoiseLayer&             layer   = layers[k];
+            std::vector <float>&    noise   = layerNoise[k];
+            std::vector <float>&    heights = layerHeights[k];
+
+            noise.resize   (sampleCount);
+            heights.resize (sampleCount);
+            noise11_octave_wrapped_batch (rangeMin, rangeMax, sampleCount, layer.scale, layer.seed, &noise[0]);
+
+            for (int i=0; i<sampleCount; i++) heights[i] = blend (k, k > 0 ? layerHeights[k-1][i] : 0.f, noise[i] * layer.amplitude);
+        }
+        firstDirty = layers.size();
+
+        return layerHeights.back();
+    }
+
+    /**
+     * Evaluates the terrain at a single input, without touching the caches.
+     *
+     * @param p - The input.
+     * @return The height.
+     */
+    float evaluate (double p) {
+        float height = 0.f;
+        for (int k=0; k<layers.size(); k++) height = blend (k, height, noise11_octave_wrapped (p, layers[k].scale, layers[k].seed) * layers[k].amplitude);
+        return height;
+    }
+
+private:
+    std::vector <NoiseLayer>            layers;                 //!<  The layers, from the bottom up
+    std::vector <std::vector <float>>   layerNoise,             //!<  Samples of each layer on its own
+                                        layerHeights;           //!<  Combined heights of each layer and every layer below it
+    int                                 firstDirty  = 0,        //!<  Index of the first layer whose caches are out of date
+                                        sampleCount = 0;        //!<  How many samples are taken
+    double                              rangeMin    = 0.0,      //!<  First input
+                                        rangeMax    = 1.0;      //!<  End of the inputs
+
+    /**
+     * Marks a layer, and so every layer above it, as out of date.
+     *
+     * @param index - Index of the layer.
+     */
+    void markDirty (int index) {
+        firstDirty = std::min (firstDirty, index);
+    }
+
+    /**
+     * Combines a layer with the heights below it.
+     *
+     * @param index - Index of the layer.
+     * @param below - Height of the layers below.
+     * @param height - Height of the layer.
+     * @return The combined height.
+     */
+    float blend (int index, float below, float height) {
+        if ( index == 0 )                   return height;
+        if ( layers[index].blend == Add )   return below + height;
+        return (below + height) / 2.f;
+    }
+};
+
+
+/**
+ * Terrain which scrolls forever, split into chunks of samples.
+ * Chunks are generated on demand, those ahead of the view on a background thread, and kept in a cache which throws
+ * out the least recently used chunk once it is full, so memory stays bounded however far the view scrolls.
+ * Sample g (of a given zoom level) lies at input g * getStep(level).
+ */
+class TerrainStream {
+public:
+    int     chunkSamples    = 250,      //!<  Samples per chunk
+            maxChunks       = 64;       //!<  How many chunks the cache holds at most
+    float   viewWidth       = 1.f;      //!<  Width of the inputs spanned by 'viewSamples' samples at zoom level 0
+    int     viewSamples     = 1000;     //!<  Samples across the view
+
+    /**
+     * Constructor. Starts the background thread.
+     */
+    TerrainStream () {
+        worker = std::thread ( [this] { work(); } );
+    }
+
+    /**
+     * Destructor. Stops the background thread.
+     */
+    ~TerrainStream () {
+        {
+            std::lock_guard <std::mutex> lock (mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    /**
+     * Sets the layers of the terrain. Every chunk made from other layers is made again when needed.
+     *
+     * @param newTerrain - The terrain (only its layers are used).
+     */
+    void setTerrain (const Terrain& newTerrain) {
+        std::lock_guard <std::mutex> lock (mutex);
+        terrain = newTerrain;
+        version++;
+        queue.clear();
+    }
+
+    /**
+     * Gets the distance between two samples.
+     *
+     * @param level - Zoom level (every level has twice as many samples as the one below).
+     * @return The distance between two samples, in inputs.
+     */
+    double getStep (int level) {
+        return (double) viewWidth / viewSamples * pow (2.0, -level);
+    }
+
+    /**
+     * Makes sure the chunks ahead of and behind a range of samples will be ready, generating them in the background.
+     *
+     * @param level - Zoom level.
+     * @param first - First sample which is in view.
+     * @param last - Last sample which is in view.
+     * @param ahead - How many chunks past either end to prepare.
+     */
+    void prefetch (int level, long long first, long long last, int ahead) {
+        std::lock_guard <std::mutex> lock (mutex);
+        long long firstChunk = floorDiv (first, chunkSamples) - ahead,
+                  lastChunk  = floorDiv (last,  chunkSamples) + ahead;
+
+        for (long long c=firstChunk; c<=lastChunk; c++) {
+            ChunkKey key { level, c };
+            auto     it = chunks.find (key);
+            if ( it != chunks.end() && it->second->version == version ) continue;
+            if ( std::find (queue.begin(), queue.end(), key) != queue.end() ) continue;
+            queue.push_back (key);
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * Gets the heights of the terrain at a run of samples, generating their chunks right away if they aren't ready.
+     * The cache is locked and looked up once per chunk, not once per sample.
+     *
+     * @param level - Zoom level.
+     * @param first - First sample.
+     * @param count - How many samples.
+     * @param out - Array of at least 'count' floats which is filled with the heights.
+     */
+    void getHeights (int level, long long first, int count, float* out) {
+        for (long long sample=first; sample<first+count; ) {
+            long long chunk  = floorDiv (sample, chunkSamples);
+            int       offset = sample - chunk * chunkSamples,
+                      amount = std::min ( (long long) chunkSamples - offset, first + count - sample );
+
+            std::unique_lock <std::mutex> lock (mutex);
+            const std::vector <float>& heights = findChunk (ChunkKey { level, chunk }, lock);
+            std::copy (heights.begin() + offset, heights.begin() + offset + amount, out);
+            lock.unlock();
+
+            out     += amount;
+            sample  += amount;
+        }
+    }
+
+    /**
+     * Gets the height of the terrain at a sample, generating its chunk right away if it isn't ready.
+     *
+     * @param level - Zoom level.
+     * @param sample - The sample.
+     * @return The height.
+     */
+    float getHeight (int level, long long sample) {
+        float height;
+        getHeights (level, sample, 1, &height);
+        return height;
+    }
+
+    /**
+     * Gets the amount of chunks in the cache.
+     *
+     * @return The amount of chunks.
+     */
+    int getChunkCount () {
+        std::lock_guard <std::mutex> lock (mutex);
+        return chunks.size();
+    }
+
+private:
+    /**
+     * Identifies a chunk.
+     */
+    struct ChunkKey {
+        int         level;  //!<  Zoom level
+        long long   index;  //!<  Index of the chunk (its first sample is index * chunkSamples)
+
+        bool operator< (const ChunkKey& other) const {
+            return level != other.level ? level < other.level : index < other.index;
+        }
+        bool operator== (const ChunkKey& other) const {
+            return level == other.level && index == other.index;
+        }
+    };
+
+    /**
+     * A generated chunk.
+     */
+    struct Chunk {
+        ChunkKey            key;        //!<  Which chunk it is
+        int                 version;    //!<  Version of the layers it was made from
+        std::vector <float> heights;    //!<  Heights of its samples
+    };
+
+    std::list <Chunk>                                       lru;            //!<  Cached chunks, most recently used first
+    std::map <ChunkKey, std::list <Chunk>::iterator>        chunks;         //!<  Cached chunks by key
+    std::deque <ChunkKey>                                   queue;          //!<  Chunks waiting for the background thread
+    Terrain                                                 terrain;        //!<  The layers
+    int                                                     version = 0;    //!<  Increased every time the layers change
+    bool                                                    stopping = false;   //!<  Whether the background thread should stop
+    std::mutex                                              mutex;          //!<  Guards everything above
+    std::condition_variable                                 wake;           //!<  Wakes the background thread
+    std::thread                                             worker;         //!<  The background thread
+
+    /**
+     * Runs on the background thread, generating queued chunks until stopped.
+     */
+    void work () {
+        std::vector <float> heights;
+        std::unique_lock <std::mutex> lock (mutex);
+
+        while ( true ) {
+            wake.wait (lock, [this] { return stopping || !queue.empty(); });
+            if ( stopping ) return;
+
+            ChunkKey key      = queue.front();
+            Terrain  layers   = terrain;
+            int      expected = version;
+            queue.pop_front();
+
+            lock.unlock();
+            generate (layers, key, heights);
+            lock.lock();
+
+            store (key, expected, heights);
+        }
+    }
+
+    /**
+     * Finds a chunk in the cache, generating it if it is missing or outdated, and marks it as the most recently used.
+     * The lock is released while generating.
+     *
+     * @param key - The chunk.
+     * @param lock - Lock on the mutex, which is held when called and when returning.
+     * @return The heights of the chunk, valid until the lock is released.
+     */
+    const std::vector <float>& findChunk (ChunkKey key, std::unique_lock <std::mutex>& lock) {
+        auto it = chunks.find (key);
+        if ( it == chunks.end() || it->second->version != version ) {
+            Terrain layers   = terrain;
+            int     expected = version;
+            lock.unlock();
+
+            std::vector <float> heights;
+            generate (layers, key, heights);
+
+            lock.lock();
+            it = store (key, expected, heights);
+        }
+
+        // Move the chunk to the front of the LRU list
+        lru.splice (lru.begin(), lru, it->second);
+        return it->second->heights;
+    }
+
+    /**
+     * Generates the heights of a chunk.
+     *
+     * @param layers - The layers of the terrain.
+     * @param key - The chunk.
+     * @param heights - Vector which is filled with the heights.
+     */
+    void generate (Terrain& layers, ChunkKey key, std::vector <float>& heights) {
+        double step = getStep (key.level);
+        layers.setRange ( key.index * chunkSamples * step, (key.index + 1) * chunkSamples * step, chunkSamples );
+        heights = layers.getHeights();
+        heights.resize (chunkSamples, 0.f);
+    }
+
+    /**
+     * Puts a chunk in the cache (unless the layers changed while it was made), throwing out the least recently used
+     * chunks if the cache is full. Must be called while holding the mutex.
+     *
+     * @param key - The chunk.
+     * @param madeFrom - Version of the layers it was made from.
+     * @param heights - The heights of the chunk.
+     * @return The chunk's place in the cache.
+     */
+    std::map <ChunkKey, std::list <Chunk>::iterator>::iterator store (ChunkKey key, int madeFrom, std::vector <float>& heights) {
+        // Keep a chunk made from the current layers over an outdated one
+        auto it = chunks.find (key);
+        if ( it != chunks.end() && madeFrom != version && it->second->version == version ) return it;
+
+        if ( it == chunks.end() ) {
+            while ( (int) chunks.size() >= maxChunks ) {
+                chunks.erase (lru.back().key);
+                lru.pop_back();
+            }
+            lru.push_front (Chunk { key, madeFrom, {} });
+            it = chunks.emplace (key, lru.begin()).first;
+        }
+
+        it->second->version = madeFrom;
+        it->second->heights.swap (heights);
+        return it;
+    }
+
+    /**
+     * Divides, rounding towards negative infinity.
+     */
+    static long long floorDiv (long long a, long long b) {
+        return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+    }
+};
+
+
+/**
+ * Runs the micro-benchmarks without a window and prints the results as JSON (one object per line).
+ * Measures sampling the noise function the way every frame does.
+ */
+void runKernelBenchmark () {
+    int         samples     = 1000,
+                frames      = 1000;
+    float       sink        = 0.f;
+    long long   allocations = allocationCount;
+    sf::Clock   clock;
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        float scale = 10.f + f % 100;
+        for (int i=0; i<samples; i++) sink += noise11_octave( (float)i/(float)samples, scale, 13242.3f );
+    }
+    printBenchmark ("noise_flat", "noise11_octave", (long long) samples * frames, clock.restart().asSeconds(), allocationCount - allocations);
+
+    std::vector <float> noise (samples);
+    allocations = allocationCount;
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        noise11_octave_batch( 0.f, 1.f, samples, 10.f + f % 100, 13242.3f, &noise[0] );
+        sink += noise[f % samples];
+    }
+    printBenchmark ("noise_flat", "noise11_octave_batch", (long long) samples * frames, clock.restart().asSeconds(), allocationCount - allocations);
+
+    if ( sink == 1234.5f ) std::cout << std::endl;  // Keeps the results from being optimized away
+}
+
+
+/**
+ * Measures how many noise samples per second the scalar and the batch noise functions take, and checks that they agree.
+ *
+ * @param samples - How many samples each frame takes.
+ * @param frames - How many frames to run.
+ */
+void runNoiseBenchmark (int samples, int frames) {
+    std::vector <float> scalar (samples),
+                        batch (samples);
+    sf::Clock           clock;
+
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        float scale = 10.f + f % 100;
+        for (int i=0; i<samples; i++) scalar[i] = noise11_octave( (float)i/(float)samples, scale, 13242.3f );
+    }
+    float scalarSeconds = clock.restart().asSeconds();
+
+    for (int f=0; f<frames; f++) noise11_octave_batch( 0.f, 1.f, samples, 10.f + f % 100, 13242.3f, &batch[0] );
+    float batchSeconds = clock.restart().asSeconds();
+
+    // Both hold the last frame, which must match bit for bit
+    int mismatches = 0;
+    for (int i=0; i<samples; i++) mismatches += memcmp( &scalar[i], &batch[i], sizeof(float) ) != 0;
+
+    // The same for the wrapped noise, far away from 0 (where the terrain ends up after a long scroll)
+    for (int f=0; f<frames; f++) noise11_octave_wrapped_batch( 1e6, 1e6 + 1.0, samples, 10.f + f % 100, 13242.3f, &batch[0] );
+    float wrappedSeconds = clock.restart().asSeconds();
+
+    for (int i=0; i<samples; i++) {
+        float wrapped = noise11_octave_wrapped( (1e6 + 1.0 - 1e6)*i/samples + 1e6, 10.f + (frames-1) % 100, 13242.3f );
+        mismatches += memcmp( &wrapped, &batch[i], sizeof(float) ) != 0;
+    }
+
+    std::cout << "samples/frame:        " << samples                                        << std::endl
+              << "frames:               " << frames                                         << std::endl
+              << "noise11_octave:       " << (double) samples * frames / scalarSeconds      << " samples/s" << std::endl
+              << "noise11_octave_batch: " << (double) samples * frames / batchSeconds       << " samples/s" << std::endl
+              << "wrapped batch:        " << (double) samples * frames / wrappedSeconds     << " samples/s" << std::endl
+              << "mismatches:           " << mismatches                                     << std::endl;
+}
+
+
+/**
+ * The main program.
+ *
+ * Usage: noise_flat [--bench-json]
+ *        noise_flat --noise-bench [samples] [frames]
+ */
+int main(int argc, char* argv[])
 {
+    // Only run the benchmarks if asked to
+    if (argc > 1 && std::string(argv[1]) == "--bench-json") {
+        runKernelBenchmark();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--noise-bench") {
+        int samples = argc > 2 ? atoi(argv[2]) : 1000000;
+        int frames  = argc > 3 ? atoi(argv[3]) : 20;
+        runNoiseBenchmark(samples, frames);
+        return 0;
+    }
+
     // Initiate the main window, clock and controls
     sf::RenderWindow window (sf::VideoMode(windowx, windowy), "Noise");
 
@@ -134,15 +642,20 @@ int main()
     std::vector <sf::Vector2f> points1;         // Blue line
     std::vector <sf::Vector2f> permapoints;     // Red mountains
     std::vector <sf::Vector2f> midline { sf::Vector2f (0, windowy/2.f), sf::Vector2f (windowx, windowy/2.f) };
+    std::vector <float>        noise;           // Noise samples of the blue line
+    std::vector <float>        heights;         // Heights of the red mountains in view
+    Terrain                    terrain;         // Layers of the red mountains
+    TerrainStream              stream;          // Chunks of the red mountains, around the view
 
     int     samples = 1000;     // Amount of samples taken
-    float   minp    = 0.f,      // Minimum p-value for noise function
-            maxp    = 1.f,      // Maximum p-value for noise function
-            seed    = 13242.3f; // Seed for noise function
+    int     zoom    = 0;        // Zoom level (each level has twice as many samples per input)
+    float   seed    = 13242.3f; // Seed for noise function
 
-    // Make 'snakes'
-    std::vector <int>   snakeCurrIndex;
-    std::vector <float> snakeCurrTime;
+    stream.viewSamples = samples;
+
+    // Make 'snakes' (the last one is the indicator dot, which the view follows)
+    std::vector <long long> snakeCurrIndex;
+    std::vector <float>     snakeCurrTime;
 
     for (int i=0; i<100; i++) {
         snakeCurrIndex.push_back ( i );
@@ -159,6 +672,18 @@ int main()
             // Close window : exit
             if (event.type == sf::Event::Closed)
                 window.close();
+
+            // Zoom in/out (up/down) around the indicator dot, and jump back/forth (left/right)
+            if (event.type == sf::Event::KeyPressed) {
+                for (int i=0; i<snakeCurrIndex.size(); i++) {
+                    if (event.key.code == sf::Keyboard::Up)     snakeCurrIndex[i] *= 2;
+                    if (event.key.code == sf::Keyboard::Down)   snakeCurrIndex[i] /= 2;
+                    if (event.key.code == sf::Keyboard::Left)   snakeCurrIndex[i] -= samples/4;
+                    if (event.key.code == sf::Keyboard::Right)  snakeCurrIndex[i] += samples/4;
+                }
+                if (event.key.code == sf::Keyboard::Up)     zoom++;
+                if (event.key.code == sf::Keyboard::Down)   zoom--;
+            }
         }
 
         // Time and controls
@@ -177,53 +702,63 @@ int main()
         float scaleX = sf::Mouse::getPosition(window).x / 5.f;
         float scaleY = windowy/2.f - sf::Mouse::getPosition(window).y;
 
+        // Advance the snakes
+        for (int i=0; i<snakeCurrIndex.size(); i++) {
+            snakeCurrTime[i] += samples/10.f * dt;
+            if (snakeCurrTime[i] >= 1.f) {
+                snakeCurrTime[i]  = 0.f;
+                snakeCurrIndex[i] += 1;
+            }
+        }
+
+        // The view is centred on the indicator dot, and scrolls smoothly with it
+        long long   first   = snakeCurrIndex.back() - samples/2;
+        float       scroll  = sstep3( snakeCurrTime.back() );
+        double      step    = stream.getStep(zoom);
+
         // Get samples from noise function
+        noise.resize(samples);
+        noise11_octave_wrapped_batch( first * step, (first + samples) * step, samples, scaleX, seed, &noise[0] );
+
         points1.clear();
         for (int i=0; i<samples; i++) {
-            float curp       = (maxp-minp)*(float)i/(float)samples + minp;
-            sf::Vector2f point ( windowx/(float)samples*(float)i, noise11_octave( curp, scaleX, seed ) * scaleY + windowy/2.f );
+            sf::Vector2f point ( windowx/(float)samples*((float)i - scroll), noise[i] * scaleY + windowy/2.f );
             points1.push_back(point);
         }
 
         // Add / average out terrain by left/rightclicking
         if (mouseHeldLeft == 1 || mouseHeldRight == 1) {
-            if (permapoints.size() == 0) {
-                permapoints = points1;
-
-            } else {
-                // Add (leftclick)
-                if (mouseHeldLeft == 1) {
-                    for (int i=0; i<samples; i++)
-                        permapoints[i].y += points1[i].y - windowy/2.f;
-
-                // Average out (rightclick)
-                } else {
-                    for (int i=0; i<samples; i++)
-                        permapoints[i].y = (permapoints[i].y + points1[i].y ) / 2.f;
-                }
-            }
+            terrain.addLayer( NoiseLayer { scaleX, scaleY, seed, mouseHeldLeft == 1 ? Add : Average } );
+            stream.setTerrain(terrain);
         }
 
-
         // Update and draw stuff
-        if (permapoints.size() > 0) {
+        if (terrain.getLayerCount() > 0) {
+            // Prepare the chunks around the view, then sample the terrain in view
+            stream.prefetch(zoom, first, first + samples, 2);
+
+            heights.resize(samples + 2);
+            stream.getHeights(zoom, first, samples + 2, &heights[0]);
+
+            permapoints.resize(samples + 1);
+            for (int i=0; i<=samples; i++)
+                permapoints[i] = sf::Vector2f ( windowx/(float)samples*((float)i - scroll), heights[i] + windowy/2.f );
+
+            // Heights for the snakes come from the samples in view when they can
+            auto heightAt = [&] (long long sample) {
+                if ( sample >= first && sample < first + samples + 2 ) return heights[sample - first];
+                return stream.getHeight(zoom, sample);
+            };
+
             // Terrain / red mountains
             drawMountains(permapoints, window, sf::Color(255,100,100), windowy);
 
             // Snakes
             for (int i=0; i<snakeCurrIndex.size(); i++) {
-                // Advance time and loop back if end is reached
-                snakeCurrTime[i] += samples/10.f * dt;
-                if (snakeCurrTime[i] >= 1.f) {
-                    snakeCurrTime[i]  = 0.f;
-                    snakeCurrIndex[i] += 1;
-                    if (snakeCurrIndex[i] >= samples-1)   snakeCurrIndex[i] = 0; // Loop to other side
-                }
-
                 // Interpolate position
-                int             currIndex   = snakeCurrIndex[i];
+                long long       currIndex   = snakeCurrIndex[i];
                 float           t           = sstep3( snakeCurrTime[i] );
-                sf::Vector2f    smooth      = lerp ( permapoints[currIndex],   permapoints[currIndex + 1], t );
+                sf::Vector2f    smooth      ( windowx/2.f, lerp ( heightAt(currIndex), heightAt(currIndex + 1), t ) + windowy/2.f );
 
                 // Move the snake off the track (except for the indicator dot)
                 if (i != snakeCurrIndex.size()-1) {
@@ -1,59 +1,172 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <map>
+#include <thread>
 #include <vector>
 #include <random>
 #include <stdlib.h>
+#include <sys/resource.h>
+
+#include "common/bench.hpp"
+#include "common/math.hpp"
+#include "common/noise.hpp"
 
 // Globals
-const double    pi      = 2.0 * acos(0.0);
 float           windowx = 800,
-                windowy = 800,
-                seed    = 1234.f;
-
-
-/**
- * Hash function
- *
- * @param p - Input.
- * @return Seemingly unrelated output between 0 and 1.
- */
-float hash11(float p)
-{
-    p = p * .1031 - floor(p * .1031);
-    p *= p + 33.33;
-    p *= p + p;
-    return p - floor(p);
-}
-
+                windowy = 800;
+uint64_t        seed    = 1234;
 
 /**
  * Midpoint displacement function (taken from lecture notes).
+ * The points lie on a ring, so the point after the last one is the first one (which is always 0).
+ * Works in place on the caller's buffer, so that it can be reused every frame without allocating.
  *
- * @param dataPoints - How many data points to return (has go be log2-able).
+ * @param nums - Buffer of at least 'dataPoints' floats, which is filled with the displacements.
+ * @param dataPoints - How many data points to generate (has go be log2-able).
  * @param alpha - How "smooth" the outputs are.
  * @param beta - How high/low the tops and bottoms can be.
- *
- * @return An array of midpoint displacements.
+ * @param hashSeed - Seed for the displacements (point i is displaced by hash64 of the i-th step of a splitmix64 sequence).
  */
-float* midpointdisp ( int dataPoints, float alpha, float beta ) {
-    // Initiate array
-    float* nums = new float[dataPoints];
+void midpointdisp ( float* nums, int dataPoints, float alpha, float beta, uint64_t hashSeed = seed ) {
     nums[0] = 0;
-    nums[dataPoints] = 0;
 
-    // Generate points
+    // Generate points, halving the distance between known points every pass
     for (int stepSize = dataPoints/2; stepSize > 0; stepSize /= 2) {
         for (int step = stepSize; step < dataPoints; step += stepSize*2) {
-            float displacement = hash11(seed + step + stepSize) * beta;
-            nums[step] = ( nums[step - stepSize] + nums[step + stepSize] ) / 2.f + displacement;
+            int   next         = step + stepSize == dataPoints ? 0 : step + stepSize;
+            float displacement = hash64_float(hashSeed + step * 0x9e3779b97f4a7c15ull) * beta;
+            nums[step] = ( nums[step - stepSize] + nums[next] ) / 2.f + displacement;
         }
         beta /= pow(2, alpha);
     }
-
-    return nums;
 }
 
 
+/**
+ * Remembers the most recently used rings (points along a circle, pushed out by midpoint displacements), so that
+ * frames where nothing changed neither generate displacements nor do any trigonometry.
+ * Rings are keyed by their parameters rounded to a fine grid, and generated from the rounded values, so the same key
+ * always gives the same ring. Once full, the least recently used ring is thrown out.
+ */
+class RingCache {
+public:
+    int     capacity        = 32;           //!<  How many rings are kept at most
+    float   alphaQuantum    = 1.f / 1024.f, //!<  Alpha is rounded to a multiple of this
+            betaQuantum     = 1.f / 16.f,   //!<  Beta is rounded to a multiple of this
+            baseRadius      = 150.f;        //!<  Radius of the circle before it is displaced
+    sf::Vector2f centre;                    //!<  Centre of the circle
+
+    /**
+     * Gets a ring, generating it if it isn't cached.
+     *
+     * @param alpha - See midpointdisp.
+     * @param beta - See midpointdisp.
+     * @param hashSeed - See midpointdisp.
+     * @param samples - How many points the ring has (has to be log2-able).
+     * @return The points of the ring (valid until the ring is thrown out of the cache).
+     */
+    const std::vector <sf::Vector2f>& getRing ( float alpha, float beta, uint64_t hashSeed, int samples ) {
+        RingKey key { (long long) std::lround (alpha / alphaQuantum), (long long) std::lround (beta / betaQuantum), hashSeed, samples };
+
+        auto it = rings.find (key);
+        if ( it != rings.end() ) {
+            hits++;
+            lru.splice (lru.begin(), lru, it->second);
+            return it->second->points;
+        }
+        misses++;
+
+        // Reuse the least recently used ring's storage (and map node) once the cache is full
+        if ( (int) rings.size() >= capacity ) {
+            auto node = rings.extract (lru.back().key);
+            lru.splice (lru.begin(), lru, std::prev (lru.end()));
+            node.key() = key;
+            rings.insert (std::move (node));
+        } else {
+            lru.emplace_front ();
+            rings[key] = lru.begin();
+        }
+        Ring& ring = lru.front();
+        ring.key   = key;
+
+        // Generate the displacements, and push the unit circle out by them
+        const std::vector <sf::Vector2f>& unit = getUnitCircle (samples);
+        displacements.resize (samples);
+        midpointdisp ( &displacements[0], samples, key.alpha * alphaQuantum, key.beta * betaQuantum, hashSeed );
+
+        ring.points.resize (samples);
+        for (int i=0; i<samples; i++) ring.points[i] = unit[i] * (baseRadius + displacements[i]) + centre;
+
+        return ring.points;
+    }
+
+    /**
+     * Gets the share of getRing calls which were answered from the cache.
+     *
+     * @return The hit rate, between 0 and 1.
+     */
+    float getHitRate () {
+        return hits + misses > 0 ? (float) hits / (hits + misses) : 0.f;
+    }
+
+private:
+    /**
+     * Identifies a ring.
+     */
+    struct RingKey {
+        long long   alpha,      //!<  Alpha, in multiples of alphaQuantum
+                    beta;       //!<  Beta, in multiples of betaQuantum
+        uint64_t    hashSeed;   //!<  Seed
+        int         samples;    //!<  Amount of points
+
+        bool operator< (const RingKey& other) const {
+            if ( alpha    != other.alpha )    return alpha    < other.alpha;
+            if ( beta     != other.beta )     return beta     < other.beta;
+            if ( hashSeed != other.hashSeed ) return hashSeed < other.hashSeed;
+            return samples < other.samples;
+        }
+    };
+
+    /**
+     * A cached ring.
+     */
+    struct Ring {
+        RingKey                     key;    //!<  Parameters of the ring
+        std::vector <sf::Vector2f>  points; //!<  Points of the ring
+    };
+
+    std::list <Ring>                                lru;            //!<  Cached rings, most recently used first
+    std::map <RingKey, std::list <Ring>::iterator>  rings;          //!<  Cached rings by key
+    std::vector <float>                             displacements;  //!<  Scratch for midpointdisp
+    std::vector <sf::Vector2f>                      unitCircle;     //!<  cos and sin of every sample's angle
+    long long                                       hits    = 0,    //!<  How many getRing calls were cached
+                                                    misses  = 0;    //!<  How many getRing calls had to generate
+
+    /**
+     * Gets the points of a circle with radius 1, computing them only when the amount of samples changes.
+     *
+     * @param samples - Amount of points.
+     * @return The points.
+     */
+    const std::vector <sf::Vector2f>& getUnitCircle ( int samples ) {
+        if ( (int) unitCircle.size() != samples ) {
+            unitCircle.resize (samples);
+            for (int i=0; i<samples; i++) {
+                float ang = (float)i/(float)samples * 2*pi;
+                unitCircle[i] = sf::Vector2f ( cos(ang), sin(ang) );
+            }
+        }
+        return unitCircle;
+    }
+};
+
+
 /**
  * Draws triangles that fill the space between a position and a given list of points.
  *
@@ -62,17 +175,14 @@ float* midpointdisp ( int dataPoints, float alpha, float beta ) {
  * @param window - The window which is drawn upon.
  * @param color - Color of the triangles.
  */
-void drawFromPosition ( std::vector <sf::Vector2f> points, sf::Vector2f position, sf::RenderWindow& window, sf::Color color = sf::Color::White ) {
+void drawFromPosition ( const std::vector <sf::Vector2f>& points, sf::Vector2f position, sf::RenderWindow& window, sf::Color color = sf::Color::White ) {
     std::vector <sf::Vertex> triangleVertex;
 
     for (int i=0; i<points.size(); i++) {
+        // Connect start and end
         sf::Vector2f    c0 = points[i],
                         c2 = position,
-                        c1 = points[i+1];
-
-        // Connect start and end
-        if (i == points.size()-1)
-                        c1 = points[0];
+                        c1 = i == points.size()-1 ? points[0] : points[i+1];
 
         triangleVertex.push_back( sf::Vertex ( c0, color ) );
         triangleVertex.push_back( sf::Vertex ( c1, color ) );
@@ -83,11 +193,265 @@ void drawFromPosition ( std::vector <sf::Vector2f> points, sf::Vector2f position
 }
 
 
+
+/**
+ * Runs the micro-benchmarks without a window and prints the results as JSON (one object per line).
+ * Measures generating one ring of midpoint displacements, the way every frame does.
+ */
+void runKernelBenchmark () {
+    int                 samples     = pow(2, 8),
+                        rings       = 100000;
+    float               sink        = 0.f;
+    std::vector <float> displacements (samples);
+    long long           allocations = allocationCount;
+    sf::Clock           clock;
+    clock.restart();
+    for (int r=0; r<rings; r++) {
+        midpointdisp ( &displacements[0], samples, 1.f + r % 3, 100.f );
+        sink += displacements[r % samples];
+    }
+    printBenchmark ("noise_round", "midpointdisp", rings, clock.restart().asSeconds(), allocationCount - allocations);
+
+    // A still mouse (every frame is a cache hit)
+    RingCache ringCache;
+    ringCache.getRing ( 1.f, 100.f, seed, samples );
+    allocations = allocationCount;
+    clock.restart();
+    for (int r=0; r<rings; r++) sink += ringCache.getRing ( 1.f, 100.f, seed, samples )[r % samples].x;
+    printBenchmark ("noise_round", "RingCache::getRing (hit)", rings, clock.restart().asSeconds(), allocationCount - allocations);
+
+    if ( sink == 1234.5f ) std::cout << std::endl;  // Keeps the results from being optimized away
+}
+
+
+/**
+ * Gets the peak resident memory of the process.
+ *
+ * @return Peak resident memory, in kilobytes.
+ */
+long getPeakMemory () {
+    rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+/**
+ * Does the work of a frame (without drawing) over and over, to check that memory stays flat over long runs.
+ *
+ * @param seconds - How long to run.
+ */
+void runSoak (float seconds) {
+    int                         samples = pow(2, 8);
+    std::vector <float>         displacements (samples);
+    std::vector <sf::Vector2f>  samplePoints;
+    long                        startMemory = getPeakMemory();
+    long long                   frames      = 0,
+                                allocations = allocationCount;
+    sf::Clock                   clock;
+    clock.restart();
+
+    while (clock.getElapsedTime().asSeconds() < seconds) {
+        midpointdisp ( &displacements[0], samples, 1.f + frames % 3, 100.f );
+
+        samplePoints.clear();
+        for (int i=0; i<samples; i++) {
+            float ang = (float)i/(float)samples * 2*pi;
+            samplePoints.push_back( sf::Vector2f ( cos(ang) * (150.f + displacements[i]), sin(ang) * (150.f + displacements[i]) ) );
+        }
+        frames++;
+    }
+
+    std::cout << "frames:               " << frames                                             << std::endl
+              << "allocations/frame:    " << (double) (allocationCount - allocations) / frames  << std::endl
+              << "peak memory:          " << startMemory << " kB at start, " << getPeakMemory() << " kB at end" << std::endl;
+}
+
+
+/**
+ * Gets the seed used for the displacements of a ring in a batch.
+ * Mixed with an integer hash, so that neighbouring seeds give unrelated rings, and no two seeds give the same one.
+ *
+ * @param ringSeed - Seed of the ring.
+ * @return Seed for midpointdisp.
+ */
+uint64_t getRingHashSeed ( unsigned int ringSeed ) {
+    return hash64 ( ringSeed ^ hash64 (seed) );
+}
+
+
+/**
+ * Generates rings (radii along a circle) for a range of seeds in parallel, and writes them to a binary file.
+ * The file starts with a header of 32 bytes: "RING", then as 32-bit values the version (1), ring count, samples per
+ * ring and first seed (unsigned), followed by alpha, beta and base radius (float). Then follow the radii of every ring
+ * as packed float32s, ring after ring. The output only depends on the arguments, not on the amount of threads.
+ *
+ * @param ringCount - How many rings to generate.
+ * @param firstSeed - Seed of the first ring (the others follow one after another).
+ * @param threads - How many threads to use.
+ * @param samples - Samples per ring (has to be log2-able).
+ * @param alpha - How "smooth" the rings are.
+ * @param beta - How high/low the tops and bottoms can be.
+ * @param path - Path of the file to write.
+ */
+void runBatch ( int ringCount, unsigned int firstSeed, int threads, int samples, float alpha, float beta, const std::string& path ) {
+    const float     baseRadius  = 150.f;
+    const int       blockRings  = 4096;     // Rings generated before they are written, so memory stays bounded
+
+    std::ofstream file (path, std::ios::binary);
+    if ( !file ) {
+        std::cerr << "could not open " << path << std::endl;
+        return;
+    }
+
+    uint32_t header[8] = { 0, 1, (uint32_t) ringCount, (uint32_t) samples, firstSeed };
+    memcpy( &header[0], "RING", 4 );
+    memcpy( &header[5], &alpha, 4 );
+    memcpy( &header[6], &beta, 4 );
+    memcpy( &header[7], &baseRadius, 4 );
+    file.write( (const char*) header, sizeof(header) );
+
+    std::vector <float>         radii ((size_t) std::min (ringCount, blockRings) * samples);
+    std::vector <std::thread>   workers;
+    sf::Clock                   clock;
+    clock.restart();
+
+    for (int blockStart=0; blockStart<ringCount; blockStart+=blockRings) {
+        int blockSize = std::min (blockRings, ringCount - blockStart);
+
+        // Every thread takes an interleaved share of the rings in the block
+        workers.clear();
+        for (int t=0; t<threads; t++) {
+            workers.emplace_back( [&, t] {
+                for (int r=t; r<blockSize; r+=threads) {
+                    float* ring = &radii[ (size_t) r * samples ];
+                    midpointdisp ( ring, samples, alpha, beta, getRingHashSeed( firstSeed + blockStart + r ) );
+                    for (int i=0; i<samples; i++) ring[i] += baseRadius;
+                }
+            } );
+        }
+        for (int t=0; t<threads; t++) workers[t].join();
+
+        file.write( (const char*) &radii[0], (size_t) blockSize * samples * sizeof(float) );
+    }
+
+    float seconds = clock.restart().asSeconds();
+
+    std::cout << "rings:                " << ringCount                          << std::endl
+              << "samples/ring:         " << samples                            << std::endl
+              << "threads:              " << threads                            << std::endl
+              << "seconds:              " << seconds                            << std::endl
+              << "rings/s:              " << ringCount / seconds                << std::endl
+              << "file:                 " << path << " (" << sizeof(header) + (size_t) ringCount * samples * sizeof(float) << " bytes)" << std::endl;
+}
+
+
+/**
+ * Checks that the rings of a batch (see runBatch) are pairwise distinct, without writing them anywhere.
+ * Every ring is reduced to a 64-bit digest; rings with the same digest are generated again and compared byte for byte.
+ *
+ * @param ringCount - How many rings to check.
+ * @param firstSeed - Seed of the first ring.
+ * @param samples - Samples per ring (has to be log2-able).
+ * @param alpha - How "smooth" the rings are.
+ * @param beta - How high/low the tops and bottoms can be.
+ * @return True if no two rings are the same.
+ */
+bool runRingCheck ( int ringCount, unsigned int firstSeed, int samples, float alpha, float beta ) {
+    std::vector <float>                             ring (samples),
+                                                    other (samples);
+    std::vector <std::pair <uint64_t, int>>         digests;
+    for (int r=0; r<ringCount; r++) {
+        midpointdisp ( &ring[0], samples, alpha, beta, getRingHashSeed( firstSeed + r ) );
+
+        uint64_t digest = 0;
+        for (int i=0; i<samples; i++) {
+            uint32_t bits;
+            memcpy( &bits, &ring[i], 4 );
+            digest = hash64 (digest ^ bits);
+        }
+        digests.push_back( std::make_pair (digest, r) );
+    }
+    std::sort (digests.begin(), digests.end());
+
+    int duplicates = 0;
+    for (int k=1; k<ringCount; k++) {
+        if ( digests[k].first != digests[k-1].first ) continue;
+        midpointdisp ( &ring[0],  samples, alpha, beta, getRingHashSeed( firstSeed + digests[k-1].second ) );
+        midpointdisp ( &other[0], samples, alpha, beta, getRingHashSeed( firstSeed + digests[k].second ) );
+        if ( memcmp( &ring[0], &other[0], samples * sizeof(float) ) == 0 ) {
+            std::cout << "seeds " << firstSeed + digests[k-1].second << " and " << firstSeed + digests[k].second << " give the same ring" << std::endl;
+            duplicates++;
+        }
+    }
+
+    std::cout << "rings:                " << ringCount      << std::endl
+              << "duplicates:           " << duplicates     << std::endl;
+    return duplicates == 0;
+}
+
+
+/**
+ * Checks the arguments of --batch and --check-rings, and says what's wrong with them on std::cerr.
+ *
+ * @param ringCount - How many rings to generate (has to be positive).
+ * @param samples - Samples per ring (has to be a positive power of two).
+ * @return True if the arguments can be used.
+ */
+bool checkRingArguments ( int ringCount, int samples ) {
+    if ( ringCount <= 0 ) {
+        std::cerr << "ring count has to be greater than 0, got " << ringCount << std::endl;
+        return false;
+    }
+    if ( samples <= 0 || (samples & (samples - 1)) != 0 ) {
+        std::cerr << "samples per ring has to be a power of two greater than 0, got " << samples << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
 /**
  * The main function.
+ *
+ * Usage: noise_round [--bench-json]
+ *        noise_round --soak [seconds]
+ *        noise_round --batch [rings] [first seed] [threads] [samples] [alpha] [beta] [file]
+ *        noise_round --check-rings [rings] [first seed] [samples] [alpha] [beta]
  */
-int main()
+int main(int argc, char* argv[])
 {
+    // Only run the benchmarks if asked to
+    if (argc > 1 && std::string(argv[1]) == "--bench-json") {
+        runKernelBenchmark();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--soak") {
+        runSoak(argc > 2 ? atof(argv[2]) : 60.f);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        int          rings     = argc > 2 ? atoi(argv[2]) : 10000;
+        unsigned int firstSeed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 0;
+        int          threads   = argc > 4 ? std::max (1, atoi(argv[4])) : std::max (1u, std::thread::hardware_concurrency());
+        int          samples   = argc > 5 ? atoi(argv[5]) : 256;
+        float        alpha     = argc > 6 ? atof(argv[6]) : 1.f;
+        float        beta      = argc > 7 ? atof(argv[7]) : 100.f;
+        std::string  path      = argc > 8 ? argv[8] : "rings.bin";
+        if ( !checkRingArguments(rings, samples) ) return 1;
+        runBatch(rings, firstSeed, threads, samples, alpha, beta, path);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--check-rings") {
+        int          rings     = argc > 2 ? atoi(argv[2]) : 100000;
+        unsigned int firstSeed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 0;
+        int          samples   = argc > 4 ? atoi(argv[4]) : 256;
+        float        alpha     = argc > 5 ? atof(argv[5]) : 1.f;
+        float        beta      = argc > 6 ? atof(argv[6]) : 100.f;
+        if ( !checkRingArguments(rings, samples) ) return 1;
+        return runRingCheck(rings, firstSeed, samples, alpha, beta) ? 0 : 1;
+    }
+
     // Initiate the main window, clock and controls
     sf::RenderWindow window (sf::VideoMode(windowx, windowy), "Noise");
     sf::Vector2f     centrepos (windowx/2.f, windowy/2.f);
@@ -96,7 +460,11 @@ int main()
     clock.restart();
 
     // Game vars
-    int     samples = pow(2, 8);     // Amount of samples taken
+    int         samples = pow(2, 8);     // Amount of samples taken
+    RingCache   ringCache;               // Rings of recent mouse positions
+    float       titleTimer = 0.f;        // Time until the cache stats in the title are updated
+
+    ringCache.centre = centrepos;
 
 	// Start the game loop
     while (window.isOpen())
@@ -117,24 +485,16 @@ int main()
         // Clear screen
         window.clear();
 
-        // Get midpoint displacements based on mouse position
+        // Get the ring of midpoint displacements based on mouse position (only generated if it isn't cached)
         float scaleX = (windowx/2.f - mousePos.x) / windowx/2.f * 3.f;
         float scaleY = (windowy/2.f - mousePos.y) / windowy/2.f * 500.f;
-        float* displacements = midpointdisp ( samples, scaleX, scaleY );
-
-        // Take samples along circle
-        std::vector <sf::Vector2f> samplePoints;
-        for (int i=0; i<samples; i++) {
-            float   ang             = (float)i/(float)samples * 2*pi,
-                    displacement    = displacements[i],
-
-                    radius          = 150.f + displacement,
-
-                    xpos            = cos(ang) * radius + windowx/2.f,
-                    ypos            = sin(ang) * radius + windowy/2.f;
+        const std::vector <sf::Vector2f>& samplePoints = ringCache.getRing ( scaleX, scaleY, seed, samples );
 
-            sf::Vector2f point ( xpos, ypos );
-            samplePoints.push_back(point);
+        // Show how often the cache is hit
+        titleTimer -= dt;
+        if (titleTimer <= 0.f) {
+            titleTimer = 1.f;
+            window.setTitle ( "Noise (ring cache hit rate: " + std::to_string( (int) (ringCache.getHitRate() * 100.f) ) + "%)" );
         }
 
         // Draw circle
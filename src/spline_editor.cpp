@@ -1,13 +1,19 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <iostream>
 #include <random>
 #include <stdlib.h>
 
+#include "common/bench.hpp"
+#include "common/math.hpp"
+#include "common/vec2.hpp"
 
-// Globals, functions & classes
-const double    pi = 2.0 * acos(0.0);       //!<  Pi.
-const int       sampleAmount = 200;         //!<  Amount of samples taken by each spline.
-const float     deltaDifference = 0.01f;   //!<  How little the part of a curve we look at is when we're doing derivation.
 
+// Globals, functions & classes
+const float     sampleTolerance = 0.25f;    //!<  How far (in pixels) a spline may stray from the straight line between two samples.
+const int       minSampleDepth  = 4,        //!<  Every spline is split into at least 2^minSampleDepth pieces when sampled...
+                minSegmentDepth = 2,        //!<  ...every segment of a composite spline into at least 2^minSegmentDepth pieces...
+                maxSampleDepth  = 12;       //!<  ...and either into at most 2^maxSampleDepth pieces.
 
 // Set up psuedo-random number generator
 std::random_device  rnddev;
@@ -16,174 +22,160 @@ std::uniform_real_distribution <float> dist(0, 1);
 
 
 /**
- * A class for simple 2D vectors.
+ * Creates a sf::Vector2f out of a Vec2
+ *
+ * @param vec - The Vec2.
+ * @return The Vec2 as a sf::Vector2f
  */
-class Vec2 {
-public:
-    float   x,  //!<  x-position (width)
-            y;  //!<  y-position (height)
+sf::Vector2f vec2ToSF (Vec2 vec) {
+    return sf::Vector2f (vec.x, vec.y);
+}
 
-    /**
-     * Standard constructor.
-     */
-    Vec2 () {};
 
-    /**
-     * Constructor.
-     */
-    Vec2 (float xpos, float ypos) {
-        x = xpos;
-        y = ypos;
-    }
-
-    /**
-     * sf::Vector2i copy constructor.
-     */
-    Vec2 (sf::Vector2i vec) {
-        x = (float) vec.x;
-        y = (float) vec.y;
-    }
+/**
+ * A composite spline made of uniform Catmull-Rom segments, one between every pair of neighbouring control points.
+ * Unlike spline(), the curve passes through every control point, each segment only depends on the four control
+ * points around it, and evaluating it takes the same time no matter how many control points there are.
+ * The ends are extended by mirroring the second (and second to last) control point.
+ */
+class CatmullRomSpline {
+public:
 
     /**
-     * Addition by another Vec2.
+     * Sets the control points.
      *
-     * @param vec - The vector to add.
-     * @return This vector, added with 'vec'.
+     * @param points - Control points.
      */
-    Vec2 operator+= (Vec2 vec) {
-        x += vec.x;
-        y += vec.y;
-        return (*this);
-    }
-    Vec2 operator+ (Vec2 vec) {
-        Vec2 ret;
-        ret.x = x + vec.x;
-        ret.y = y + vec.y;
-        return ret;
+    void setControlPoints (const std::vector <Vec2>& points) {
+        controlPoints = points;
     }
 
     /**
-     * Subtraction by another Vec2.
+     * Gets the amount of segments.
      *
-     * @param vec - The vector to subtract.
-     * @return This vector, subtracted by 'vec'.
+     * @return The amount of segments (a single point still makes one segment).
      */
-    Vec2 operator-= (Vec2 vec) {
-        x -= vec.x;
-        y -= vec.y;
-        return (*this);
-    }
-    Vec2 operator- (Vec2 vec) {
-        Vec2 ret;
-        ret.x = x - vec.x;
-        ret.y = y - vec.y;
-        return ret;
+    int getSegmentCount () {
+        if ( controlPoints.empty() ) return 0;
+        return std::max (1, (int) controlPoints.size() - 1);
     }
 
     /**
-     * Division by number.
+     * Evaluates a segment.
      *
-     * @param num - The number to divide by.
-     * @return This vector, divided by 'num'.
+     * @param segment - The segment (between control point 'segment' and 'segment+1').
+     * @param u - Time within the segment, between 0 and 1.
+     * @return The position of a point on the segment.
      */
-    Vec2 operator/= (float num) {
-        x /= num;
-        y /= num;
-        return (*this);
-    }
-    Vec2 operator/ (float n) {
-        Vec2 ret;
-        ret.x = x / n;
-        ret.y = y / n;
-        return ret;
+    Vec2 evaluate (int segment, float u) {
+        Vec2 p0 = getPoint (segment - 1),
+             p1 = getPoint (segment),
+             p2 = getPoint (segment + 1),
+             p3 = getPoint (segment + 2);
+
+        return ( p1 * 2.f
+               + (p2 - p0) * u
+               + (p0 * 2.f - p1 * 5.f + p2 * 4.f - p3) * (u * u)
+               + (p1 * 3.f - p0 - p2 * 3.f + p3) * (u * u * u) ) * 0.5f;
     }
 
     /**
-     * Multiplication by number.
+     * Evaluates the derivative of a segment, with respect to the time within the segment.
      *
-     * @param num - The number to multiplicate by.
-     * @return This vector, multiplied by 'num'.
+     * @param segment - The segment (between control point 'segment' and 'segment+1').
+     * @param u - Time within the segment, between 0 and 1.
+     * @return The derivative.
      */
-    Vec2 operator*= (float num) {
-        x *= num;
-        y *= num;
-        return (*this);
-    }
-    Vec2 operator* (float n) {
-        Vec2 ret;
-        ret.x = x * n;
-        ret.y = y * n;
-        return ret;
-    }
-    friend Vec2 operator* (float n, Vec2 u) {
-        return u * n;
+    Vec2 derivative (int segment, float u) {
+        Vec2 p0 = getPoint (segment - 1),
+             p1 = getPoint (segment),
+             p2 = getPoint (segment + 1),
+             p3 = getPoint (segment + 2);
+
+        return ( (p2 - p0)
+               + (p0 * 2.f - p1 * 5.f + p2 * 4.f - p3) * (2.f * u)
+               + (p1 * 3.f - p0 - p2 * 3.f + p3) * (3.f * u * u) ) * 0.5f;
     }
 
     /**
-     * Dot product.
+     * Evaluates the whole curve, where every segment takes up an equal part of the time.
      *
-     * @param vec - The vector to dot with.
-     * @return The dot product between this and 'vec'.
+     * @param t - Unclamped time.
+     * @return The position of a point on the curve.
      */
-    float operator* (Vec2 vec) {
-        return x*vec.x + y*vec.y;
+    Vec2 evaluate (float t) {
+        int   segment;
+        float u;
+        locate (t, segment, u);
+        return evaluate (segment, u);
     }
 
     /**
-     * Length.
+     * Evaluates the derivative of the whole curve (see evaluate(t)).
      *
-     * @return The length of this vector.
+     * @param t - Unclamped time.
+     * @return The derivative.
      */
-    float len () {
-        return sqrt(pow(x,2) + pow(y,2));
+    Vec2 derivative (float t) {
+        int   segment;
+        float u;
+        locate (t, segment, u);
+        return derivative (segment, u) * (float) getSegmentCount();
     }
 
     /**
-     * Distance.
+     * Finds the segment and the time within it for a time on the whole curve.
      *
-     * @param vec - The other vector.
-     * @return Distance between this vector and the other.
+     * @param t - Unclamped time.
+     * @param segment - Set to the segment.
+     * @param u - Set to the time within the segment.
      */
-    float dist(Vec2 vec) {
-        return ((*this) - vec).len();
+    void locate (float t, int& segment, float& u) {
+        int segments = getSegmentCount();
+        if      (t < 0) t = 0;
+        else if (t > 1) t = 1;
+
+        float x = t * segments;
+        segment = std::min ((int) x, segments - 1);
+        u       = x - segment;
     }
 
-    /**
-     * Normalization.
-     *
-     * @return A new Vec2 that is this, normalized.
-     */
-    Vec2 norm () {
-        return (*this) / (*this).len();
-    }
+private:
+    std::vector <Vec2> controlPoints;   //!<  Control points
 
     /**
-     * Orthagonal.
+     * Gets a control point, mirroring the neighbours of the ends for indices outside the curve.
      *
-     * @return A new Vec2 which is orthagonal to this.
+     * @param i - Index of the control point.
+     * @return The control point.
      */
-    Vec2 orth () {
-        return Vec2 (-y, x);
+    Vec2 getPoint (int i) {
+        int n = controlPoints.size();
+        if ( i < 0 )  return n > 1 ? controlPoints[0] * 2.f - controlPoints[1] : controlPoints[0];
+        if ( i >= n ) return n > 1 ? controlPoints[n-1] * 2.f - controlPoints[n-2] : controlPoints[n-1];
+        return controlPoints[i];
     }
 };
 
+
 /**
- * Creates a sf::Vector2f out of a Vec2
- *
- * @param vec - The Vec2.
- * @return The Vec2 as a sf::Vector2f
+ * The kinds of spline a River can follow.
  */
-sf::Vector2f vec2ToSF (Vec2 vec) {
-    return sf::Vector2f (vec.x, vec.y);
-}
+enum SplineMode {
+    Bezier,         //!<  One Bézier curve through all control points (spline() with lerp)
+    CatmullRom      //!<  One Catmull-Rom segment between every pair of neighbouring control points
+};
 
 
 /**
  * A simple struct for samples taken from spline()
  */
 struct Sample {
-    Vec2    pos;
-    float   t;
+    Vec2    pos,        //!<  Position on the curve
+            tangent,    //!<  Normalized direction of the curve
+            normal;     //!<  Normalized direction orthogonal to the curve
+    float   t,          //!<  Time-coordinate on the curve
+            length;     //!<  Arc length from the start of the curve to this sample
 };
 
 
@@ -197,32 +189,6 @@ float linBounce (float f0, float f1, float t) {
     return abs(floor(t) - t + 0.5) * (f0 - f1) * 2 + f1;
 }
 
-/**
- * Lerps between two floats.
- *
- * @param f0 - Start value.
- * @param f1 - End value.
- * @param t  - Unclamped time.
- */
-float lerp (float f0, float f1, float t) {
-    if      (t < 0) t = 0;
-    else if (t > 1) t = 1;
-    return f0 + (f1 - f0) * t;
-}
-
-/**
- * Lerps between two vectors.
- *
- * @param p0 - Start position.
- * @param p1 - End position.
- * @param t  - Unclamped time.
- */
-Vec2 lerp (Vec2 p0, Vec2 p1, float t) {
-    if      (t < 0) t = 0;
-    else if (t > 1) t = 1;
-    return p0 + (p1 - p0) * t;
-}
-
 /**
  * Lerps between two colors.
  *
@@ -267,6 +233,9 @@ Vec2 weird (Vec2 p0, Vec2 p1, float t) {
  * Splines with a given list of control-points.
  * note: the curve doesn't necessarely touch any other points than the first and last.
  *
+ * The levels are interpolated in place in a scratch buffer which is reused between calls, so this doesn't allocate
+ * (unless it is called with more control points than ever before).
+ *
  * @param points     - Control points.
  * @param t          - Unclamped time.
  * @param f          - Interpolation function.
@@ -274,33 +243,452 @@ Vec2 weird (Vec2 p0, Vec2 p1, float t) {
  *
  * @return The position of a point on the spline curve at the given time.
  */
-Vec2 spline (std::vector <Vec2> points, float t, Vec2 (*f)(Vec2, Vec2, float) = lerp, int loopAround = 0 ) {
-    std::vector <Vec2> derivatives = points;
-    std::vector <Vec2> nextDerivatives;
+Vec2 spline (const std::vector <Vec2>& points, float t, Vec2 (*f)(Vec2, Vec2, float) = lerp, int loopAround = 0 ) {
+    static thread_local std::vector <Vec2> scratch;
+    scratch.assign (points.begin(), points.end());
 
     // Interpolate every 'derivative' except the last with the next until there's only one left
-    while (derivatives.size() > 1) {
+    int count = scratch.size();
+    while (count > 1) {
+        Vec2 first = scratch[0];
+
+        for (int i=0; i<count-1; i++) {
+            scratch[i] = f (scratch[i], scratch[i+1], t);
+        }
+
+        if ( loopAround > 0 ) {
+            loopAround--;
+            scratch[count-1] = f (scratch[count-1], first, t);
+        } else {
+            count--;
+        }
+    }
+
+    return scratch[0];
+}
+
+
+/**
+ * Evaluates a spline made with lerp (see spline()), and its derivative, in Bernstein form.
+ * The binomial-weighted control points (and those of the hodograph, the curve of the derivative) are computed once in
+ * setControlPoints, after which every evaluation is linear in the amount of control points instead of quadratic,
+ * and nothing is allocated.
+ */
+class SplineEvaluator {
+public:
+
+    /**
+     * Sets the control points and precomputes the weights.
+     *
+     * @param points - Control points.
+     */
+    void setControlPoints (const std::vector <Vec2>& points) {
+        controlPoints = points;
+        degree        = (int) points.size() - 1;
+
+        // The hodograph of a degree n curve has the control points n * (points[i+1] - points[i])
+        hodographPoints.clear();
+        for (int i=0; i<degree; i++) hodographPoints.push_back( (controlPoints[i+1] - controlPoints[i]) * (float)degree );
+
+        setWeights (controlPoints,   weightsX,          weightsY);
+        setWeights (hodographPoints, hodographWeightsX, hodographWeightsY);
+    }
+
+    /**
+     * Evaluates the spline.
+     *
+     * @param t - Unclamped time.
+     * @return The position of a point on the spline curve at the given time.
+     */
+    Vec2 evaluate (float t) {
+        return evaluateBernstein (controlPoints, weightsX, weightsY, t);
+    }
+
+    /**
+     * Evaluates the spline at several times at once.
+     *
+     * @param t - Array of 'count' unclamped times.
+     * @param count - How many times there are.
+     * @param out - Array of 'count' positions which is filled with the points on the spline curve.
+     */
+    void evaluate (const float* t, int count, Vec2* out) {
+        for (int i=0; i<count; i++) out[i] = evaluate (t[i]);
+    }
+
+    /**
+     * Evaluates the exact derivative (velocity) of the spline.
+     * Outside of [0, 1] this is the derivative at the nearest end, rather than the 0 of the clamped curve.
+     *
+     * @param t - Unclamped time.
+     * @return The derivative of the spline curve at the given time.
+     */
+    Vec2 derivative (float t) {
+        if ( degree < 1 ) return Vec2 (0, 0);
+        return evaluateBernstein (hodographPoints, hodographWeightsX, hodographWeightsY, t);
+    }
 
-        for (int i=0; i<derivatives.size(); i++) {
-            Vec2 derivative      = derivatives[i];
-            Vec2 nextDerivative  = derivatives[i+1];
+    /**
+     * Evaluates the derivative of the spline at several times at once.
+     *
+     * @param t - Array of 'count' unclamped times.
+     * @param count - How many times there are.
+     * @param out - Array of 'count' vectors which is filled with the derivatives.
+     */
+    void derivative (const float* t, int count, Vec2* out) {
+        for (int i=0; i<count; i++) out[i] = derivative (t[i]);
+    }
 
-            if ( i != derivatives.size() - 1) {
-                nextDerivatives.push_back( f (derivative, nextDerivative, t) );
+private:
+    static const int        maxBernsteinDegree = 512;   //!<  Highest degree evaluated in Bernstein form
+    std::vector <Vec2>      controlPoints,              //!<  Control points
+                            hodographPoints;            //!<  Control points of the derivative
+    std::vector <double>    weightsX,                   //!<  Binomial-weighted x-coordinates of the control points
+                            weightsY,                   //!<  Binomial-weighted y-coordinates of the control points
+                            hodographWeightsX,          //!<  Binomial-weighted x-coordinates of the hodograph
+                            hodographWeightsY;          //!<  Binomial-weighted y-coordinates of the hodograph
+    int                     degree = -1;                //!<  Degree of the curve (amount of control points - 1)
 
-            } else if ( loopAround > 0 ) {
-                loopAround--;
-                nextDerivative = derivatives[0];
-                nextDerivatives.push_back( f (derivative, nextDerivative, t) );
+    /**
+     * Computes weight[i] = (n choose i) * points[i], where n is the degree of the points.
+     *
+     * @param points - Control points.
+     * @param weightsX - Filled with the weighted x-coordinates.
+     * @param weightsY - Filled with the weighted y-coordinates.
+     */
+    void setWeights (const std::vector <Vec2>& points, std::vector <double>& weightsX, std::vector <double>& weightsY) {
+        int n = (int) points.size() - 1;
+        weightsX.resize (points.size());
+        weightsY.resize (points.size());
+
+        double binomial = 1.0;
+        for (int i=0; i<=n; i++) {
+            weightsX[i] = binomial * points[i].x;
+            weightsY[i] = binomial * points[i].y;
+            binomial    = binomial * (n - i) / (i + 1);
+        }
+    }
+
+    /**
+     * Evaluates a Bézier curve in Bernstein form.
+     *
+     * @param points - Control points (used when the degree is too high for the weights).
+     * @param weightsX - Weighted x-coordinates of the control points.
+     * @param weightsY - Weighted y-coordinates of the control points.
+     * @param t - Unclamped time.
+     * @return The point on the curve.
+     */
+    Vec2 evaluateBernstein (const std::vector <Vec2>& points, const std::vector <double>& weightsX, const std::vector <double>& weightsY, float t) {
+        int n = (int) points.size() - 1;
+        if ( n < 0 ) return Vec2 (0, 0);
+
+        // Very high degrees would overflow the binomials, so fall back to interpolating
+        if ( n > maxBernsteinDegree ) return spline (points, t, lerp);
+
+        // Every lerp clamps its time, which is the same as clamping it once
+        if      (t < 0) t = 0;
+        else if (t > 1) t = 1;
+
+        // Horner's scheme on sum(weight[i] * t^i * s^(n-i)), factoring out whichever of t and s is larger
+        double  tt = t,
+                s  = 1.0 - tt,
+                x  = 0.0,
+                y  = 0.0;
+
+        if ( tt < 0.5 ) {
+            double ratio = tt / s;
+            for (int i=n; i>=0; i--) {
+                x = x * ratio + weightsX[i];
+                y = y * ratio + weightsY[i];
             }
+            double scale = pow (s, n);
+            return Vec2 (x * scale, y * scale);
         }
 
-        derivatives = nextDerivatives;
-        nextDerivatives.clear();
+        double ratio = s / tt;
+        for (int i=0; i<=n; i++) {
+            x = x * ratio + weightsX[i];
+            y = y * ratio + weightsY[i];
+        }
+        double scale = pow (tt, n);
+        return Vec2 (x * scale, y * scale);
     }
+};
 
-    return derivatives[0];
-}
+
+/**
+ * A fixed-capacity pool of particles which fly from a start to an end position over one second.
+ * Every property lives in its own contiguous float array, so aging and moving them are plain loops over floats.
+ * Expired particles are removed by moving the last particle into their slot.
+ */
+class ParticlePool {
+public:
+    std::vector <float>     startX,     //!<  x of each particle's start position
+                            startY,     //!<  y of each particle's start position
+                            endX,       //!<  x of each particle's end position
+                            endY,       //!<  y of each particle's end position
+                            age,        //!<  Time (between 0 and 1) of each particle
+                            posX,       //!<  Current x of each particle (set by update)
+                            posY;       //!<  Current y of each particle (set by update)
+
+    /**
+     * Constructor.
+     *
+     * @param maxParticles - How many particles there can be at once.
+     */
+    ParticlePool (int maxParticles = 100000) {
+        setCapacity (maxParticles);
+    }
+
+    /**
+     * Sets how many particles there can be at once. Particles beyond the new capacity are removed.
+     *
+     * @param maxParticles - How many particles there can be at once.
+     */
+    void setCapacity (int maxParticles) {
+        capacity = maxParticles;
+        count    = std::min (count, capacity);
+        startX.resize (capacity);
+        startY.resize (capacity);
+        endX.resize   (capacity);
+        endY.resize   (capacity);
+        age.resize    (capacity);
+        posX.resize   (capacity);
+        posY.resize   (capacity);
+    }
+
+    /**
+     * Gets the amount of living particles. They are the first 'size()' elements of every array.
+     *
+     * @return The amount of particles.
+     */
+    int size () {
+        return count;
+    }
+
+    /**
+     * Spawns a particle, unless the pool is full.
+     *
+     * @param p0 - Start position.
+     * @param p1 - End position.
+     * @return Whether or not the particle was spawned.
+     */
+    bool spawn (Vec2 p0, Vec2 p1) {
+        if ( count >= capacity ) return false;
+
+        startX[count] = p0.x;
+        startY[count] = p0.y;
+        endX[count]   = p1.x;
+        endY[count]   = p1.y;
+        age[count]    = 0.f;
+        count++;
+        return true;
+    }
+
+    /**
+     * Ages every particle, removes those that are too old, and moves the rest.
+     *
+     * @param dt - How much time has passed since the last update.
+     */
+    void update (float dt) {
+        float* a = &age[0];
+        for (int i=0; i<count; i++) a[i] += dt;
+
+        // Swap-and-pop the old ones (without advancing, since a new particle takes slot i)
+        for (int i=0; i<count; ) {
+            if ( age[i] > 1.f ) {
+                count--;
+                startX[i] = startX[count];
+                startY[i] = startY[count];
+                endX[i]   = endX[count];
+                endY[i]   = endY[count];
+                age[i]    = age[count];
+            } else {
+                i++;
+            }
+        }
+
+        float       *x  = &posX[0],    *y  = &posY[0];
+        const float *x0 = &startX[0],  *y0 = &startY[0],
+                    *x1 = &endX[0],    *y1 = &endY[0];
+        for (int i=0; i<count; i++) {
+            x[i] = x0[i] + (x1[i] - x0[i]) * a[i];
+            y[i] = y0[i] + (y1[i] - y0[i]) * a[i];
+        }
+    }
+
+private:
+    int     capacity = 0,   //!<  Maximum amount of particles
+            count    = 0;   //!<  Amount of living particles
+};
+
+
+/**
+ * A uniform grid over sample points, for finding the nearest sample (or all samples within a radius) of a position
+ * without looking at every sample.
+ * The samples are bucketed by cell into one flat array (a counting sort), so rebuilding doesn't allocate once the
+ * arrays have grown to fit.
+ */
+class SampleGrid {
+public:
+
+    /**
+     * Builds the grid over the given samples.
+     *
+     * @param samplePoints - The samples. They must outlive the grid (or the next build).
+     */
+    void build (const std::vector <Sample*>& samplePoints) {
+        samples = samplePoints;
+        int n   = samples.size();
+        if ( n == 0 ) return;
+
+        // Bounding box, and the length of the curve (to get roughly a handful of samples per cell)
+        float minX = samples[0]->pos.x, maxX = minX,
+              minY = samples[0]->pos.y, maxY = minY,
+              length = 0.f;
+        for (int i=0; i<n; i++) {
+            Vec2 p = samples[i]->pos;
+            minX = std::min (minX, p.x);  maxX = std::max (maxX, p.x);
+            minY = std::min (minY, p.y);  maxY = std::max (maxY, p.y);
+            if ( i > 0 ) length += p.dist( samples[i-1]->pos );
+        }
+
+        originX  = minX;
+        originY  = minY;
+        cellSize = std::max (length / n * 4.f, 1.f);
+        do {
+            cols = (int) ((maxX - minX) / cellSize) + 1;
+            rows = (int) ((maxY - minY) / cellSize) + 1;
+            if ( (long long) cols * rows > 16ll * n ) cellSize *= 2.f;
+        } while ( (long long) cols * rows > 16ll * n );
+
+        // Count samples per cell, turn counts into starts, then place the samples
+        cellStart.assign (cols * rows + 1, 0);
+        cellItems.resize (n);
+        for (int i=0; i<n; i++) cellStart[ getCell (samples[i]->pos) + 1 ]++;
+        for (int c=0; c<cols * rows; c++) cellStart[c+1] += cellStart[c];
+
+        cellFill.assign (cellStart.begin(), cellStart.end() - 1);
+        for (int i=0; i<n; i++) cellItems[ cellFill[ getCell (samples[i]->pos) ]++ ] = i;
+    }
+
+    /**
+     * Gets the nearest sample. Ties go to the sample that came first.
+     *
+     * @param pos - The position.
+     * @return The sample nearest to the position (nullptr if there are none).
+     */
+    Sample* nearest (Vec2 pos) {
+        if ( samples.empty() ) return nullptr;
+
+        int     cx        = getCoord (pos.x, originX, cols),
+                cy        = getCoord (pos.y, originY, rows),
+                best      = -1;
+        double  bestDist2 = 0.0;
+
+        // Search rings of cells around the position's cell, until nothing outside them can be closer
+        for (int r=0; ; r++) {
+            int x0 = cx - r, x1 = cx + r,
+                y0 = cy - r, y1 = cy + r;
+
+            for (int y=std::max (y0, 0); y<=std::min (y1, rows-1); y++) {
+                for (int x=std::max (x0, 0); x<=std::min (x1, cols-1); x++) {
+                    if ( y != y0 && y != y1 && x != x0 && x != x1 ) continue;  // Only the ring itself
+
+                    int cell = y * cols + x;
+                    for (int k=cellStart[cell]; k<cellStart[cell+1]; k++) {
+                        int     i     = cellItems[k];
+                        Vec2    d     = samples[i]->pos - pos;
+                        double  dist2 = (double)d.x*d.x + (double)d.y*d.y;
+                        if ( best == -1 || dist2 < bestDist2 || (dist2 == bestDist2 && i < best) ) {
+                            best      = i;
+                            bestDist2 = dist2;
+                        }
+                    }
+                }
+            }
+
+            if ( x0 <= 0 && y0 <= 0 && x1 >= cols-1 && y1 >= rows-1 ) break;
+
+            // Everything not searched yet is at least this far away
+            float bound = INFINITY;
+            if ( x0 > 0 )       bound = std::min (bound, pos.x - (originX + x0 * cellSize));
+            if ( x1 < cols-1 )  bound = std::min (bound, (originX + (x1+1) * cellSize) - pos.x);
+            if ( y0 > 0 )       bound = std::min (bound, pos.y - (originY + y0 * cellSize));
+            if ( y1 < rows-1 )  bound = std::min (bound, (originY + (y1+1) * cellSize) - pos.y);
+            if ( best != -1 && bound > 0.f && bestDist2 < (double)bound * bound ) break;
+        }
+
+        return samples[best];
+    }
+
+    /**
+     * Gets every sample within a radius, in the order they came in.
+     *
+     * @param pos - The position.
+     * @param radius - The radius.
+     * @param found - Vector which is filled with the samples.
+     */
+    void within (Vec2 pos, float radius, std::vector <Sample*>& found) {
+        found.clear();
+        if ( samples.empty() ) return;
+
+        int x0 = getCoord (pos.x - radius, originX, cols),
+            x1 = getCoord (pos.x + radius, originX, cols),
+            y0 = getCoord (pos.y - radius, originY, rows),
+            y1 = getCoord (pos.y + radius, originY, rows);
+
+        foundIndices.clear();
+        for (int y=y0; y<=y1; y++) {
+            for (int x=x0; x<=x1; x++) {
+                int cell = y * cols + x;
+                for (int k=cellStart[cell]; k<cellStart[cell+1]; k++) {
+                    int i = cellItems[k];
+                    if ( samples[i]->pos.dist(pos) <= radius ) foundIndices.push_back (i);
+                }
+            }
+        }
+
+        std::sort (foundIndices.begin(), foundIndices.end());
+        for (int k=0; k<foundIndices.size(); k++) found.push_back (samples[ foundIndices[k] ]);
+    }
+
+private:
+    std::vector <Sample*>   samples;        //!<  The samples
+    std::vector <int>       cellStart,      //!<  Where each cell's samples start in 'cellItems' (one extra at the end)
+                            cellItems,      //!<  Indices of the samples, sorted by cell
+                            cellFill,       //!<  Scratch for build()
+                            foundIndices;   //!<  Scratch for within()
+    float                   originX  = 0.f, //!<  Left edge of the grid
+                            originY  = 0.f, //!<  Top edge of the grid
+                            cellSize = 1.f; //!<  Width and height of every cell
+    int                     cols     = 1,   //!<  Amount of cells horizontally
+                            rows     = 1;   //!<  Amount of cells vertically
+
+    /**
+     * Gets the cell-coordinate of a position along one axis, clamped to the grid.
+     *
+     * @param p - The position.
+     * @param origin - Where the grid starts along the axis.
+     * @param cellCount - Amount of cells along the axis.
+     * @return The coordinate.
+     */
+    int getCoord (float p, float origin, int cellCount) {
+        float c = floor ((p - origin) / cellSize);
+        if      ( !(c >= 0.f) )     c = 0.f;    // Also catches NaN
+        else if ( c > cellCount-1 ) c = cellCount - 1;
+        return (int) c;
+    }
+
+    /**
+     * Gets the index of the cell containing a position.
+     *
+     * @param pos - The position.
+     * @return The cell index.
+     */
+    int getCell (Vec2 pos) {
+        return getCoord (pos.y, originY, rows) * cols + getCoord (pos.x, originX, cols);
+    }
+};
 
 
 /**
@@ -316,24 +704,70 @@ public:
                 particleColorFade;  //!<  End color of the water-particles
 
     /**
-     * Sets the River's sample points and removes the old.
+     * Frees the samples.
      */
-    void setControlPoints (std::vector <Vec2> points) {
+    ~River () {
+        for (int i=0; i<samplePoints.size(); i++) delete samplePoints[i];
+        for (int i=0; i<spareSamples.size(); i++) delete spareSamples[i];
+    }
+
+    /**
+     * Sets the River's control points and samples the curve again, unless nothing changed.
+     * Every segment of the curve (all of it, for a Bézier curve) is split in half until every piece is within
+     * 'sampleTolerance' of a straight line, so straight stretches get few samples and tight bends get many.
+     * For a Catmull-Rom curve, only segments that depend on a changed control point are sampled again.
+     *
+     * @param points - The control points.
+     */
+    void setControlPoints (const std::vector <Vec2>& points) {
+        int oldCount = controlPoints.size(),
+            newCount = points.size(),
+            common   = std::min (oldCount, newCount),
+            front    = 0,
+            back     = 0;
+        while ( front < common && samePoint (points[front], controlPoints[front]) ) front++;
+        while ( back < common - front && samePoint (points[newCount-1-back], controlPoints[oldCount-1-back]) ) back++;
+        if ( oldCount == newCount && front == newCount && mode == sampledMode ) return;
+
         controlPoints = points;
+        resample (front, back);
+    }
 
-        // Clear old sample points and make new
-        for (int i=0; i<samplePoints.size(); i++) delete samplePoints[i];
-        samplePoints.clear();
+    /**
+     * Moves a control point, sampling again only if it actually moved.
+     *
+     * @param index - Index of the control point.
+     * @param pos - Its new position.
+     */
+    void moveControlPoint (int index, Vec2 pos) {
+        if ( samePoint (controlPoints[index], pos) ) return;
 
-        for (int i=0; i<sampleAmount; i++) {
-            float t = 1.f / (float)sampleAmount * (float)i;
+        int count = controlPoints.size();
+        controlPoints[index] = pos;
+        resample (index, count - 1 - index);
+    }
 
-            Sample* samplePoint = new Sample;
-            samplePoint->pos = spline (controlPoints, t, lerp);
-            samplePoint->t   = t;
+    /**
+     * Inserts a control point.
+     *
+     * @param index - Index of the new control point.
+     * @param pos - Its position.
+     */
+    void insertControlPoint (int index, Vec2 pos) {
+        int count = controlPoints.size();
+        controlPoints.insert (controlPoints.begin() + index, pos);
+        resample (index, count - index);
+    }
 
-            samplePoints.push_back (samplePoint);
-        }
+    /**
+     * Removes a control point.
+     *
+     * @param index - Index of the control point.
+     */
+    void removeControlPoint (int index) {
+        int count = controlPoints.size();
+        controlPoints.erase (controlPoints.begin() + index);
+        resample (index, count - 1 - index);
     }
 
     /**
@@ -341,7 +775,35 @@ public:
      *
      * @return The River's control points.
      */
-    std::vector <Vec2>      getControlPoints()  { return controlPoints; }
+    const std::vector <Vec2>& getControlPoints()  { return controlPoints; }
+
+    /**
+     * Gets the amount of sample points.
+     *
+     * @return The amount of sample points.
+     */
+    int getSampleCount () {
+        return samplePoints.size();
+    }
+
+    /**
+     * Gets how far (in pixels) the curve strays from the straight lines between the sample points, at most.
+     * Measured at the middle of every piece, so it is an estimate.
+     *
+     * @return The error.
+     */
+    float getSampleError () {
+        return sampleError;
+    }
+
+    /**
+     * Gets the (approximate) length of the river.
+     *
+     * @return The length.
+     */
+    float getLength () {
+        return samplePoints.empty() ? 0.f : samplePoints.back()->length;
+    }
 
     /**
      * Gets the River's sample points.
@@ -357,20 +819,18 @@ public:
      * @return The sample point nearest to the position.
      */
     Sample* getNearestSample (Vec2 pos) {
-        Sample* nearestSample = nullptr;
-        float   nearestSampleDist = -1.f;
-
-        for (int i=0; i<samplePoints.size(); i++) {
-            Sample* sample      = samplePoints[i];
-            float   sampleDist  = sample->pos.dist(pos);
-
-            if (nearestSample == nullptr || sampleDist < nearestSampleDist) {
-                nearestSample       = sample;
-                nearestSampleDist   = sampleDist;
-            }
-        }
+        return sampleGrid.nearest (pos);
+    }
 
-        return nearestSample;
+    /**
+     * Gets every sample point within a radius.
+     *
+     * @param pos - The position.
+     * @param radius - The radius.
+     * @param found - Vector which is filled with the sample points, in order.
+     */
+    void getSamplesWithin (Vec2 pos, float radius, std::vector <Sample*>& found) {
+        sampleGrid.within (pos, radius, found);
     }
 
     /**
@@ -380,7 +840,15 @@ public:
      * @return The index of the closest control point to the time-coordinate.
      */
     int getNearestControlPoint ( float t ) {
-        Vec2    samplePoint = spline ( controlPoints, t, lerp );
+        // Catmull-Rom segments start at their control point
+        if ( mode == CatmullRom ) {
+            int   segment;
+            float u;
+            catmullRom.locate (t, segment, u);
+            return segment;
+        }
+
+        Vec2    samplePoint = evaluator.evaluate ( t );
         float   index       = -1,
                 dist        = -1;
 
@@ -398,19 +866,34 @@ public:
     }
 
     /**
-     * Gets the (approximate) velocity at a given time-coordinate.
+     * Gets the velocity at a given time-coordinate.
      *
      * @param t - The time.
-     * @return The approximate velocity at the time.
+     * @return The velocity at the time.
      */
     Vec2 getVelocity (float t) {
-        float   t0 = t - deltaDifference / 2.f,
-                t1 = t + deltaDifference / 2.f;
+        if ( mode == CatmullRom ) return catmullRom.derivative ( t );
+        return evaluator.derivative ( t );
+    }
 
-        Vec2    p0 = spline ( controlPoints, t0, lerp ),
-                p1 = spline ( controlPoints, t1, lerp );
+    /**
+     * Sets which kind of spline the river follows, and samples it again if it changed.
+     *
+     * @param splineMode - The kind of spline.
+     */
+    void setMode (SplineMode splineMode) {
+        if ( splineMode == mode ) return;
+        mode = splineMode;
+        resample (0, 0);
+    }
 
-        return  ( p1 - p0 ) / deltaDifference;
+    /**
+     * Gets which kind of spline the river follows.
+     *
+     * @return The kind of spline.
+     */
+    SplineMode getMode () {
+        return mode;
     }
 
     /**
@@ -424,100 +907,465 @@ public:
         Vec2 p0  = pos;
         Vec2 p1  = p0 + vel * flowSpeed;
 
-        particlesP0.push_back   (p0);
-        particlesP1.push_back   (p1);
-        particlesT.push_back    (0);
+        particles.spawn (p0, p1);
+    }
+
+    /**
+     * Sets how many particles the river can have at once.
+     *
+     * @param maxParticles - The maximum amount of particles.
+     */
+    void setMaxParticles (int maxParticles) {
+        particles.setCapacity (maxParticles);
     }
 
     /**
      * Draws the river.
+     * The geometry is only rebuilt when the control points (or the width) change, so every frame just recolors it.
      *
      * @param dt - How much time has passed since the last call.
      * @param window - The window to draw upon.
      */
     void draw (float dt, sf::RenderWindow& window) {
         riverAge += dt;
+        if ( width != meshWidth ) buildMesh();
 
-        // Make two triangles that together look like a trapezoid connecting this sample with the next
-        std::vector <sf::Vertex> triangleVertex;
-
-        for (int i=0; i<samplePoints.size()-1; i++) {
-            Sample      samplePoint0 = *samplePoints[i];
-            float       t0     = samplePoint0.t;
-            Vec2        pos0   = samplePoint0.pos,
-                        vel0   = getVelocity(t0);
-            sf::Color   color0 = lerp ( waterColor, flowColor, linBounce(0, 1, t0 - riverAge) );
-
-            Sample      samplePoint1 = *samplePoints[i+1];
-            float       t1     = samplePoint1.t;
-            Vec2        pos1   = samplePoint1.pos,
-                        vel1   = getVelocity(t1);
-            sf::Color   color1 = lerp ( waterColor, flowColor, linBounce(0, 1, t1 - riverAge) );
-
-            // First triangle
-            sf::Vertex  corner0 ( vec2ToSF( pos0 + vel0.norm().orth() * width ), color0 ),
-                        corner1 ( vec2ToSF( pos0 - vel0.norm().orth() * width ), color0 ),
-                        corner2 ( vec2ToSF( pos1 - vel1.norm().orth() * width ), color1 );
-
-            triangleVertex.push_back(corner0);
-            triangleVertex.push_back(corner1);
-            triangleVertex.push_back(corner2);
-
-            // Second triangle
-            sf::Vertex  corner3 ( vec2ToSF( pos1 + vel1.norm().orth() * width ), color1 ),
-                        corner4 ( vec2ToSF( pos1 - vel1.norm().orth() * width ), color1 ),
-                        corner5 ( vec2ToSF( pos0 + vel0.norm().orth() * width ), color0 );
-
-            triangleVertex.push_back(corner3);
-            triangleVertex.push_back(corner4);
-            triangleVertex.push_back(corner5);
+        // Let the flow color pulsate along the river
+        for (int i=0; i<mesh.getVertexCount(); i++) {
+            mesh[i].color = lerp ( waterColor, flowColor, linBounce(0, 1, meshU[i] - riverAge) );
         }
+        window.draw(mesh);
 
-        // Iterate through particles and add their triangles to the vertex
-        for (int i=0; i<particlesT.size(); i++) {
-            particlesT[i] = particlesT[i] + dt;
+        // Update particles and make a triangle for each
+        particles.update (dt);
+        particleVertex.resize (particles.size() * 3);
 
-            // Remove particle if it's too old
-            if ( particlesT[i] > 1.f ) {
-                particlesP0.erase( particlesP0.begin() + i );
-                particlesP1.erase( particlesP1.begin() + i );
-                particlesT.erase ( particlesT.begin()  + i );
-                continue;
-            }
+        float   c = cos(pi/4.f),
+                s = sin(pi/4.f);
 
-            // Make the triangle and add it to vector
-            Vec2        particlePos = lerp ( particlesP0[i], particlesP1[i], particlesT[i] );
-            sf::Color   particleCol = lerp ( particleColor, particleColorFade, particlesT[i] );
-            float       c           = cos(pi/4.f),
-                        s           = sin(pi/4.f);
+        for (int i=0; i<particles.size(); i++) {
+            sf::Vector2f    particlePos ( particles.posX[i], particles.posY[i] );
+            sf::Color       particleCol = lerp ( particleColor, particleColorFade, particles.age[i] );
 
-            sf::Vertex  corner0 ( vec2ToSF(particlePos + Vec2 ( 0     , s*-5.f )) , particleCol ),
-                        corner1 ( vec2ToSF(particlePos + Vec2 ( c*5.f , s*5.f  )) , particleCol ),
-                        corner2 ( vec2ToSF(particlePos + Vec2 ( c*-5.f, s*5.f  )) , particleCol );
-
-            triangleVertex.push_back( corner0 );
-            triangleVertex.push_back( corner1 );
-            triangleVertex.push_back( corner2 );
+            particleVertex[i*3  ] = sf::Vertex ( particlePos + sf::Vector2f ( 0     , s*-5.f ) , particleCol );
+            particleVertex[i*3+1] = sf::Vertex ( particlePos + sf::Vector2f ( c*5.f , s*5.f  ) , particleCol );
+            particleVertex[i*3+2] = sf::Vertex ( particlePos + sf::Vector2f ( c*-5.f, s*5.f  ) , particleCol );
         }
 
-        window.draw(&triangleVertex[0], triangleVertex.size(), sf::Triangles);
+        if ( !particleVertex.empty() ) window.draw(&particleVertex[0], particleVertex.size(), sf::Triangles);
     }
 
 private:
-    std::vector <Vec2>      controlPoints,          //!<  Control points
-                            particlesP0,            //!<  P0 (start position) of particles
-                            particlesP1;            //!<  P1 (end position) of particles
-    std::vector <float>     particlesT;             //!<  t (time between 0 and 1) of particles
+    std::vector <Vec2>      controlPoints;          //!<  Control points
+    ParticlePool            particles;              //!<  Particles
     std::vector <Sample*>   samplePoints;           //!<  Sample points
-    float                   riverAge;               //!<  How 'old' the river is (how much it has been updated)
+    SampleGrid              sampleGrid;             //!<  Spatial index over the sample points
+    SplineEvaluator         evaluator;              //!<  Evaluates the spline through the control points
+    float                   riverAge  = 0.f,        //!<  How 'old' the river is (how much it has been updated)
+                            meshWidth = -1.f;       //!<  Width the mesh was built with
+    sf::VertexArray         mesh;                   //!<  Triangle strip covering the river, two vertices per sample
+    std::vector <float>     meshU;                  //!<  Arc length (between 0 and 1) of each vertex in the mesh
+    std::vector <float>     sampleU;                //!<  Time-coordinate of each sample within its segment
+    std::vector <int>       segmentStart;           //!<  Index of the first sample (after the start) of every segment, plus the end
+    std::vector <float>     segmentError;           //!<  Largest measured distance between each segment and its samples
+    std::vector <Sample*>   spareSamples,           //!<  Samples which are not in use, kept for reuse
+                            oldSamples;             //!<  The previous samples (scratch for resample)
+    std::vector <float>     oldU,                   //!<  The previous sampleU (scratch for resample)
+                            oldError;               //!<  The previous segmentError (scratch for resample)
+    std::vector <int>       oldStart;               //!<  The previous segmentStart (scratch for resample)
+    float                   sampleError = 0.f;      //!<  Largest measured distance between the curve and its samples
+    CatmullRomSpline        catmullRom;             //!<  The composite curve through the control points
+    SplineMode              mode        = Bezier,   //!<  Which curve the river follows
+                            sampledMode = Bezier;   //!<  Which curve the current samples were taken from
+    std::vector <sf::Vertex> particleVertex;        //!<  Triangles of the particles (reused every frame)
+
+    /**
+     * Builds the river's triangle strip from its sample points.
+     * Each sample gets a vertex on either side, 'width' along its normal.
+     */
+    void buildMesh () {
+        meshWidth = width;
+        mesh.setPrimitiveType (sf::TriangleStrip);
+        mesh.resize (samplePoints.size() * 2);
+        meshU.resize (samplePoints.size() * 2);
+
+        // Flow along the arc length rather than along t, so it has the same speed everywhere
+        float length = std::max (getLength(), 1e-6f);
+
+        for (int i=0; i<samplePoints.size(); i++) {
+            Sample* sample = samplePoints[i];
+            mesh[i*2  ].position = vec2ToSF( sample->pos + sample->normal * width );
+            mesh[i*2+1].position = vec2ToSF( sample->pos - sample->normal * width );
+            meshU[i*2  ] = sample->length / length;
+            meshU[i*2+1] = sample->length / length;
+        }
+    }
+
+    /**
+     * Samples the curve again after its control points changed.
+     * Samples are never freed, only put aside for reuse, so editing a curve of a similar size does not allocate.
+     *
+     * @param front - How many control points at the start are unchanged.
+     * @param back - How many control points at the end are unchanged (not overlapping with 'front').
+     */
+    void resample (int front, int back) {
+        if ( mode == Bezier ) evaluator.setControlPoints  (controlPoints);
+        else                  catmullRom.setControlPoints (controlPoints);
+
+        // Segment k depends on control points k-1 to k+2, so the segments further than two points away are unchanged
+        int oldSegments = segmentStart.empty() ? 0 : segmentStart.size() - 1,
+            newSegments = mode == Bezier ? (controlPoints.empty() ? 0 : 1) : catmullRom.getSegmentCount(),
+            keepFront   = 0,
+            keepBack    = 0;
+        if ( mode == CatmullRom && sampledMode == CatmullRom ) {
+            keepFront = std::max (0, front - 2);
+            keepBack  = std::max (0, back - 2);
+        }
+        sampledMode = mode;
+
+        // Put together the new samples from the kept ones at the front, new ones, and the kept ones at the back
+        oldSamples.swap (samplePoints);
+        oldU.swap       (sampleU);
+        oldStart.swap   (segmentStart);
+        oldError.swap   (segmentError);
+        samplePoints.clear();
+        sampleU.clear();
+        segmentStart.clear();
+        segmentError.clear();
+
+        if ( newSegments > 0 ) {
+            if ( keepFront > 0 ) {
+                addSample (oldSamples[0], oldU[0]);
+                oldSamples[0] = nullptr;
+            } else {
+                addSample (newSample (0, 0.f), 0.f);
+            }
+        }
+
+        sampleError = 0.f;
+        for (int k=0; k<newSegments; k++) {
+            segmentStart.push_back (samplePoints.size());
+
+            int oldK = k < keepFront ? k : (k >= newSegments - keepBack ? k - newSegments + oldSegments : -1);
+            if ( oldK != -1 ) {
+                for (int i=oldStart[oldK]; i<oldStart[oldK+1]; i++) {
+                    addSample (oldSamples[i], oldU[i]);
+                    oldSamples[i] = nullptr;
+                }
+                segmentError.push_back (oldError[oldK]);
+            } else {
+                Vec2 start = samplePoints.back()->pos,
+                     end   = curvePoint (k, 1.f);
+                segmentError.push_back (0.f);
+                subdivide (k, 0.f, start, 1.f, end, 0);
+            }
+            sampleError = std::max (sampleError, segmentError.back());
+        }
+        if ( newSegments > 0 ) segmentStart.push_back (samplePoints.size());
+
+        for (int i=0; i<oldSamples.size(); i++) {
+            if ( oldSamples[i] ) spareSamples.push_back (oldSamples[i]);
+        }
+
+        // Time-coordinates and arc lengths are cheap to redo for every sample
+        float length = 0.f;
+        for (int k=0; k<newSegments; k++) {
+            for (int i=std::max (segmentStart[k], 1) - (k == 0 ? 1 : 0); i<segmentStart[k+1]; i++) {
+                if ( i > 0 ) length += samplePoints[i]->pos.dist( samplePoints[i-1]->pos );
+                samplePoints[i]->t      = (k + sampleU[i]) / newSegments;
+                samplePoints[i]->length = length;
+            }
+        }
+
+        sampleGrid.build (samplePoints);
+        buildMesh();
+    }
+
+    /**
+     * Samples a segment between two samples, adding every new sample (including the end, but not the start).
+     *
+     * @param segment - The segment.
+     * @param u0 - Time-coordinate of the start, within the segment.
+     * @param p0 - Position of the start.
+     * @param u1 - Time-coordinate of the end, within the segment.
+     * @param p1 - Position of the end.
+     * @param depth - How many times the segment has been split to get here.
+     */
+    void subdivide (int segment, float u0, Vec2 p0, float u1, Vec2 p1, int depth) {
+        float um = (u0 + u1) / 2.f;
+        Vec2  pm = curvePoint (segment, um);
+
+        // Distance from the middle of the curve to the line segment between the ends
+        Vec2  chord   = p1 - p0,
+              offset  = pm - p0;
+        float chord2  = chord * chord,
+              along   = chord2 > 0.f ? std::max (0.f, std::min (1.f, (offset * chord) / chord2)) : 0.f,
+              error   = (offset - chord * along).len();
+
+        int   minDepth = mode == Bezier ? minSampleDepth : minSegmentDepth;
+        if ( depth < maxSampleDepth && (depth < minDepth || error > sampleTolerance) ) {
+            subdivide (segment, u0, p0, um, pm, depth + 1);
+            subdivide (segment, um, pm, u1, p1, depth + 1);
+            return;
+        }
+
+        segmentError.back() = std::max (segmentError.back(), error);
+        addSample (newSample (segment, u1, p1), u1);
+    }
+
+    /**
+     * Makes a new sample, reusing a spare one if there is any. Its time-coordinate and arc length are set by resample.
+     *
+     * @param segment - The segment.
+     * @param u - Time-coordinate within the segment.
+     * @return The sample.
+     */
+    Sample* newSample (int segment, float u) {
+        return newSample (segment, u, curvePoint (segment, u));
+    }
+    Sample* newSample (int segment, float u, Vec2 pos) {
+        Sample* sample;
+        if ( spareSamples.empty() ) {
+            sample = new Sample;
+        } else {
+            sample = spareSamples.back();
+            spareSamples.pop_back();
+        }
+        sample->pos     = pos;
+        sample->tangent = curveVelocity (segment, u).norm();
+        sample->normal  = sample->tangent.orth();
+        return sample;
+    }
+
+    /**
+     * Appends a sample.
+     *
+     * @param sample - The sample.
+     * @param u - Time-coordinate of the sample within its segment.
+     */
+    void addSample (Sample* sample, float u) {
+        samplePoints.push_back (sample);
+        sampleU.push_back (u);
+    }
+
+    /**
+     * Evaluates the curve the river follows.
+     *
+     * @param segment - The segment (always 0 for a Bézier curve).
+     * @param u - Time-coordinate within the segment.
+     * @return The position.
+     */
+    Vec2 curvePoint (int segment, float u) {
+        if ( mode == CatmullRom ) return catmullRom.evaluate (segment, u);
+        return evaluator.evaluate (u);
+    }
+
+    /**
+     * Evaluates the derivative of the curve the river follows, within a segment.
+     *
+     * @param segment - The segment (always 0 for a Bézier curve).
+     * @param u - Time-coordinate within the segment.
+     * @return The derivative.
+     */
+    Vec2 curveVelocity (int segment, float u) {
+        if ( mode == CatmullRom ) return catmullRom.derivative (segment, u);
+        return evaluator.derivative (u);
+    }
+
+    /**
+     * Checks whether two points are exactly the same.
+     *
+     * @param a - A point.
+     * @param b - Another point.
+     * @return Whether or not they are the same.
+     */
+    bool samePoint (Vec2 a, Vec2 b) {
+        return a.x == b.x && a.y == b.y;
+    }
 };
 
 
+/**
+ * The original spline(), which copies the control points and every level of interpolation.
+ * Only kept as a baseline for runSplineBenchmark().
+ *
+ * @param points     - Control points.
+ * @param t          - Unclamped time.
+ * @param f          - Interpolation function.
+ *
+ * @return The position of a point on the spline curve at the given time.
+ */
+Vec2 splineCopying (std::vector <Vec2> points, float t, Vec2 (*f)(Vec2, Vec2, float) = lerp) {
+    std::vector <Vec2> derivatives = points;
+    std::vector <Vec2> nextDerivatives;
+
+    while (derivatives.size() > 1) {
+        for (int i=0; i<derivatives.size()-1; i++) {
+            nextDerivatives.push_back( f (derivatives[i], derivatives[i+1], t) );
+        }
+
+        derivatives = nextDerivatives;
+        nextDerivatives.clear();
+    }
+
+    return derivatives[0];
+}
+
+
+/**
+ * Measures how fast a spline can be evaluated, without a window.
+ * Compares the original copying spline(), the in-place spline() and the SplineEvaluator (batched).
+ *
+ * @param pointCount - How many control points the spline has.
+ * @param evaluations - How many times to evaluate each.
+ */
+void runSplineBenchmark (int pointCount, int evaluations) {
+    std::vector <Vec2> points;
+    for (int i=0; i<pointCount; i++) points.push_back( Vec2 (dist(gen) * 900, dist(gen) * 900) );
+
+    std::vector <float> times   (evaluations);
+    std::vector <Vec2>  results (evaluations),
+                        reference (evaluations);
+    for (int i=0; i<evaluations; i++) times[i] = (float)i / (float)evaluations;
+
+    sf::Clock   clock;
+    long long   allocations;
+
+    // Original
+    allocations = allocationCount;
+    clock.restart();
+    for (int i=0; i<evaluations; i++) reference[i] = splineCopying (points, times[i], lerp);
+    float       copyingSeconds      = clock.restart().asSeconds();
+    long long   copyingAllocations  = allocationCount - allocations;
+
+    // In place
+    allocations = allocationCount;
+    clock.restart();
+    for (int i=0; i<evaluations; i++) results[i] = spline (points, times[i], lerp);
+    float       inPlaceSeconds      = clock.restart().asSeconds();
+    long long   inPlaceAllocations  = allocationCount - allocations;
+
+    // Bernstein form, batched
+    SplineEvaluator evaluator;
+    evaluator.setControlPoints (points);
+    allocations = allocationCount;
+    clock.restart();
+    evaluator.evaluate (&times[0], evaluations, &results[0]);
+    float       bernsteinSeconds     = clock.restart().asSeconds();
+    long long   bernsteinAllocations = allocationCount - allocations;
+
+    float maxError = 0.f;
+    for (int i=0; i<evaluations; i++) maxError = std::max (maxError, results[i].dist(reference[i]));
+
+    std::cout << "control points:       " << pointCount << std::endl
+              << "evaluations:          " << evaluations << std::endl
+              << "copying spline():     " << copyingSeconds   * 1e9 / evaluations << " ns/eval, "
+                                          << (double) copyingAllocations / evaluations << " allocations/eval" << std::endl
+              << "in-place spline():    " << inPlaceSeconds   * 1e9 / evaluations << " ns/eval, "
+                                          << (double) inPlaceAllocations / evaluations << " allocations/eval" << std::endl
+              << "SplineEvaluator:      " << bernsteinSeconds * 1e9 / evaluations << " ns/eval, "
+                                          << (double) bernsteinAllocations / evaluations << " allocations/eval" << std::endl
+              << "max difference:       " << maxError << " px" << std::endl;
+
+    // Adaptive sampling of the same spline
+    River river;
+    river.width = 25.f;
+    allocations = allocationCount;
+    clock.restart();
+    river.setControlPoints (points);
+    float       samplingSeconds     = clock.restart().asSeconds();
+    long long   samplingAllocations = allocationCount - allocations;
+
+    std::cout << "setControlPoints():   " << samplingSeconds * 1e6 << " us, "
+                                          << samplingAllocations << " allocations, "
+                                          << river.getSampleCount() << " samples, "
+                                          << river.getSampleError() << " px error" << std::endl;
+
+    // Dragging the middle control point back and forth, as main does every frame, in both modes
+    for (int m=0; m<2; m++) {
+        river.setMode (m == 0 ? Bezier : CatmullRom);
+        int  drags  = 1000,
+             index  = pointCount / 2;
+        Vec2 origin = points[index];
+        for (int i=0; i<16; i++) river.moveControlPoint (index, origin + Vec2 (0.f, (float) (i % 8)));
+
+        allocations = allocationCount;
+        clock.restart();
+        for (int i=0; i<drags; i++) river.moveControlPoint (index, origin + Vec2 (0.f, (float) (i % 8)));
+        float       dragSeconds     = clock.restart().asSeconds();
+        long long   dragAllocations = allocationCount - allocations;
+
+        std::cout << (m == 0 ? "drag (Bezier):        " : "drag (Catmull-Rom):   ")
+                  << dragSeconds * 1e6 / drags << " us/move, "
+                  << (double) dragAllocations / drags << " allocations/move" << std::endl;
+    }
+}
+
+
+
+/**
+ * Runs the micro-benchmarks without a window and prints the results as JSON (one object per line).
+ * Measures evaluating a spline with 20 control points, and finding the nearest sample of a river along it.
+ */
+void runKernelBenchmark () {
+    std::mt19937                            gen (1234);
+    std::uniform_real_distribution <float>  dist (0, 1);
+    std::vector <Vec2>                      points,
+                                            queries;
+    for (int i=0; i<20; i++)   points.push_back( Vec2 (dist(gen) * 900, dist(gen) * 900) );
+    for (int i=0; i<1000; i++) queries.push_back( Vec2 (dist(gen) * 900, dist(gen) * 900) );
+
+    int         evaluations = 100000;
+    float       sink        = 0.f;
+    sf::Clock   clock;
+
+    // spline()
+    long long allocations = allocationCount;
+    clock.restart();
+    for (int i=0; i<evaluations; i++) sink += spline (points, (float) i / evaluations).x;
+    printBenchmark ("spline_editor", "spline", evaluations, clock.restart().asSeconds(), allocationCount - allocations);
+
+    // SplineEvaluator
+    SplineEvaluator evaluator;
+    evaluator.setControlPoints (points);
+    allocations = allocationCount;
+    clock.restart();
+    for (int i=0; i<evaluations; i++) sink += evaluator.evaluate ((float) i / evaluations).x;
+    printBenchmark ("spline_editor", "SplineEvaluator::evaluate", evaluations, clock.restart().asSeconds(), allocationCount - allocations);
+
+    // River::getNearestSample
+    River river;
+    river.width = 25.f;
+    river.setControlPoints (points);
+    allocations = allocationCount;
+    clock.restart();
+    for (int i=0; i<evaluations; i++) sink += river.getNearestSample (queries[i % queries.size()])->t;
+    printBenchmark ("spline_editor", "River::getNearestSample", evaluations, clock.restart().asSeconds(), allocationCount - allocations);
+
+    if ( sink == 1234.5f ) std::cout << std::endl;  // Keeps the results from being optimized away
+}
+
+
 /**
  * The main program.
+ *
+ * Usage: spline_editor [--bench [control points] [evaluations]]
+ *        spline_editor --bench-json
  */
-int main()
+int main(int argc, char* argv[])
 {
+    // Only run the benchmark if asked to
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        int pointCount  = argc > 2 ? atoi(argv[2]) : 20;
+        int evaluations = argc > 3 ? atoi(argv[3]) : 10000;
+        runSplineBenchmark(pointCount, evaluations);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-json") {
+        runKernelBenchmark();
+        return 0;
+    }
+
     // Create window
     int resX = 900; //!<  Screen width
     int resY = 900; //!<  Screen height
@@ -556,6 +1404,10 @@ int main()
         {
             if (event.type == sf::Event::Closed)
                 window.close();
+
+            // Switch between one Bézier curve and Catmull-Rom segments
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Space)
+                river.setMode (river.getMode() == Bezier ? CatmullRom : Bezier);
         }
 
         // Timers
@@ -568,7 +1420,7 @@ int main()
         // Modify curve
         Vec2                mousePos        = Vec2 (sf::Mouse::getPosition(window));
         Sample*             nearestSample   = river.getNearestSample(mousePos);
-        std::vector <Vec2>  controlPoints   = river.getControlPoints();
+        const std::vector <Vec2>& controlPoints = river.getControlPoints();
 
         if ( sf::Mouse::isButtonPressed ( sf::Mouse::Button::Left ) ) {
 
@@ -578,13 +1430,11 @@ int main()
 
                 // Remove control point if rightclick is pressed
                 if ( sf::Mouse::isButtonPressed ( sf::Mouse::Button::Right )) {
-                    controlPoints.erase( controlPoints.begin() + definingPoint );
-                    river.setControlPoints(controlPoints);
+                    river.removeControlPoint (definingPoint);
                     definingPoint = -1;
 
                 } else {
-                    controlPoints[definingPoint] = mousePos;
-                    river.setControlPoints(controlPoints);
+                    river.moveControlPoint (definingPoint, mousePos);
                 }
 
             } else {
@@ -603,8 +1453,7 @@ int main()
                     int nearestControlPoint = river.getNearestControlPoint ( nearestSample->t ) ;
                     definingPoint = nearestControlPoint + 1;
 
-                    controlPoints.insert ( controlPoints.begin() + definingPoint , mousePos );
-                    river.setControlPoints (controlPoints);
+                    river.insertControlPoint (definingPoint, mousePos);
                 }
             }
 
@@ -1,16 +1,24 @@
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <random>
 #include <iostream>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "common/bench.hpp"
+#include "common/circle_batch.hpp"
+#include "common/math.hpp"
+#include "common/thread_pool.hpp"
 
 
 // Globals, functions & classes
-const double    pi              = 2.0 * acos(0.0);  //!<  Pi.
 const int       windowx         = 900,              //!<  Screen width.
                 windowy         = 900;              //!<  Screen height.
 const float     seed            = 1284.5f,          //!<  Seed.
                 gravity         = 98.1f,            //!<  Gravity.
-                windVelocity    = -1000.f,          //!<  Windspeed.
-                fluidConstant   = 0.1f;             //!<  Fluid constant.
+                windVelocity    = -1000.f,          //!<  Prevailing windspeed, which the wind field returns to.
+                fluidConstant   = 0.1f,             //!<  Fluid constant.
+                restitution     = 0.9f;             //!<  How much speed is kept after a bounce.
 
 
 // Set up psuedo-random number generator
@@ -18,20 +26,250 @@ std::random_device  rnddev;
 std::mt19937        gen(rnddev());
 std::uniform_real_distribution <float> dist(0, 1);
 
-
 /**
- * Lerps between two floats.
- *
- * @param f0 - Start value.
- * @param f1 - End value.
- * @param t  - Unclamped time.
+ * A coarse grid of wind velocities covering the window, which evolves like a (cheap) fluid.
+ * Every step lets the wind diffuse, carries it along itself (semi-Lagrangian advection) and pulls it back towards the prevailing wind.
+ * There is no pressure projection, so the wind isn't kept divergence-free; it only has to blow balls around.
+ * Each component is stored in its own flat array, row by row, and each pass is split into bands of rows for the thread pool.
  */
-float lerp (float f0, float f1, float t) {
-    if      (t < 0) t = 0;
-    else if (t > 1) t = 1;
-    return f0 + (f1 - f0) * t;
-}
+class WindField {
+public:
+    float   diffusion   = 2000.f,   //!<  How fast the wind spreads out (px^2/s)
+            relaxation  = 0.5f;     //!<  How fast the wind returns to the prevailing wind (1/s)
+    int     iterations  = 4;        //!<  Jacobi iterations per diffusion step
 
+    /**
+     * Constructor.
+     * The wind starts out blowing with the prevailing wind everywhere.
+     *
+     * @param columns - Amount of cells across the window (at least 2).
+     * @param rows - Amount of cells down the window (at least 2).
+     * @param threadPool - Threads which step the field.
+     */
+    WindField (int columns, int rows, ThreadPool& threadPool) : pool(threadPool) {
+        cols    = std::max (2, columns);
+        rowCount= std::max (2, rows);
+        cellx   = (float) windowx / cols;
+        celly   = (float) windowy / rowCount;
+
+        int cells = cols * rowCount;
+        u.assign    (cells, windVelocity);
+        v.assign    (cells, 0.f);
+        uPrev.assign(cells, windVelocity);
+        vPrev.assign(cells, 0.f);
+        uNext.assign(cells, windVelocity);
+        vNext.assign(cells, 0.f);
+        bandCount = std::min (rowCount, pool.size() * 4);
+    }
+
+    /**
+     * Pushes the wind near a point towards a velocity, like dragging a hand through it.
+     *
+     * @param pos - Centre of the disturbance.
+     * @param vel - Velocity the wind is pushed towards.
+     * @param radius - Radius of the disturbance.
+     */
+    void stir (sf::Vector2f pos, sf::Vector2f vel, float radius) {
+        int i0 = std::max ( 0,          (int) ((pos.x - radius) / cellx) ),
+            i1 = std::min ( cols - 1,   (int) ((pos.x + radius) / cellx) ),
+            j0 = std::max ( 0,          (int) ((pos.y - radius) / celly) ),
+            j1 = std::min ( rowCount - 1, (int) ((pos.y + radius) / celly) );
+
+        for (int j=j0; j<=j1; j++) {
+            for (int i=i0; i<=i1; i++) {
+                float dx        = (i + 0.5f) * cellx - pos.x,
+                      dy        = (j + 0.5f) * celly - pos.y,
+                      weight    = 1.f - sqrt(dx*dx + dy*dy) / radius;
+                if (weight <= 0.f) continue;
+
+                int cell = j * cols + i;
+                u[cell] += (vel.x - u[cell]) * weight;
+                v[cell] += (vel.y - v[cell]) * weight;
+            }
+        }
+    }
+
+    /**
+     * Advances the wind by one step.
+     * Diffusion is implicit and advection traces backwards, so any timestep is stable.
+     * Doesn't allocate.
+     *
+     * @param dt - How much time passed since last step.
+     */
+    void step (float dt) {
+        // Diffuse
+        float ax = dt * diffusion / (cellx * cellx),
+              ay = dt * diffusion / (celly * celly);
+        std::swap (u, uPrev);
+        std::swap (v, vPrev);
+        std::copy (uPrev.begin(), uPrev.end(), u.begin());
+        std::copy (vPrev.begin(), vPrev.end(), v.begin());
+
+        auto diffuseJob = [&] (int band) {
+            int first = bandStart(band), last = bandStart(band + 1);
+            for (int j=first; j<last; j++) {
+                diffuseRow (&uNext[0], &uPrev[0], &u[0], j, ax, ay);
+                diffuseRow (&vNext[0], &vPrev[0], &v[0], j, ax, ay);
+            }
+        };
+        for (int k=0; k<iterations; k++) {
+            pool.run (bandCount, diffuseJob);
+            std::swap (u, uNext);
+            std::swap (v, vNext);
+        }
+
+        // Advect, and return towards the prevailing wind
+        float   pull = 1.f - exp(-relaxation * dt);
+        std::swap (u, uPrev);
+        std::swap (v, vPrev);
+
+        auto advectJob = [&] (int band) {
+            int first = bandStart(band), last = bandStart(band + 1);
+            for (int j=first; j<last; j++) advectRow (j, dt, pull);
+        };
+        pool.run (bandCount, advectJob);
+    }
+
+    /**
+     * Gets the wind at a point, interpolated between the nearest cells.
+     * Points outside the window get the wind at its edge.
+     *
+     * @param pos - The point.
+     * @return The wind velocity.
+     */
+    sf::Vector2f sample (sf::Vector2f pos) const {
+        float gx = std::min ( std::max (pos.x / cellx - 0.5f, 0.f), cols - 1.f ),
+              gy = std::min ( std::max (pos.y / celly - 0.5f, 0.f), rowCount - 1.f );
+        int   i  = std::min ( (int) gx, cols - 2 ),
+              j  = std::min ( (int) gy, rowCount - 2 ),
+              c  = j * cols + i;
+        float fx = gx - i,
+              fy = gy - j;
+
+        return sf::Vector2f ( bilinear (&u[c], fx, fy), bilinear (&v[c], fx, fy) );
+    }
+
+    /**
+     * Gets the amount of cells across the window.
+     *
+     * @return The amount of columns.
+     */
+    int getColumns () const {
+        return cols;
+    }
+
+    /**
+     * Gets the amount of cells down the window.
+     *
+     * @return The amount of rows.
+     */
+    int getRows () const {
+        return rowCount;
+    }
+
+private:
+    int                 cols,               //!<  Cells across
+                        rowCount,           //!<  Cells down
+                        bandCount;          //!<  Bands of rows each pass is split into
+    float               cellx,              //!<  Cell width (px)
+                        celly;              //!<  Cell height (px)
+    std::vector <float> u, v,               //!<  Current wind
+                        uPrev, vPrev,       //!<  Wind before the current pass
+                        uNext, vNext;       //!<  Wind after the current Jacobi iteration
+    ThreadPool&         pool;               //!<  Threads which step the field
+
+    /**
+     * Gets the first row of a band.
+     *
+     * @param band - The band, or the band count for the end of the last one.
+     * @return The row.
+     */
+    int bandStart (int band) const {
+        return (long long) band * rowCount / bandCount;
+    }
+
+    /**
+     * Interpolates between the 4 cells starting at a cell.
+     *
+     * @param cell - The top-left cell.
+     * @param fx - How far towards the right column (0 to 1).
+     * @param fy - How far towards the bottom row (0 to 1).
+     * @return The interpolated value.
+     */
+    float bilinear (const float* cell, float fx, float fy) const {
+        float top    = cell[0]    + (cell[1]        - cell[0])    * fx,
+              bottom = cell[cols] + (cell[cols + 1] - cell[cols]) * fx;
+        return top + (bottom - top) * fy;
+    }
+
+    /**
+     * Does one Jacobi iteration of implicit diffusion for a row; cells past the edges count as the edge itself.
+     *
+     * @param out - Where the new values are written.
+     * @param prev - The values before diffusion.
+     * @param cur - The values from the previous iteration.
+     * @param j - The row.
+     * @param ax - Horizontal diffusion per step, relative to the cell width.
+     * @param ay - Vertical diffusion per step, relative to the cell height.
+     */
+    void diffuseRow (float* __restrict out, const float* __restrict prev, const float* __restrict cur, int j, float ax, float ay) const {
+        const float* __restrict row  = cur + j * cols;
+        const float* __restrict up   = cur + std::max (j - 1, 0) * cols;
+        const float* __restrict down = cur + std::min (j + 1, rowCount - 1) * cols;
+        const float* __restrict src  = prev + j * cols;
+        float* __restrict       dst  = out + j * cols;
+        float                   inv  = 1.f / (1.f + 2.f*ax + 2.f*ay);
+        int                     last = cols - 1;
+
+        dst[0]    = ( src[0]    + ax * (row[0]    + row[1])        + ay * (up[0]    + down[0]) )    * inv;
+        #pragma omp simd
+        for (int i=1; i<last; i++) {
+            dst[i] = ( src[i] + ax * (row[i - 1] + row[i + 1]) + ay * (up[i] + down[i]) ) * inv;
+        }
+        dst[last] = ( src[last] + ax * (row[last - 1] + row[last]) + ay * (up[last] + down[last]) ) * inv;
+    }
+
+    /**
+     * Advects a row by tracing every cell back along the wind, then pulls it towards the prevailing wind.
+     * Reads from uPrev and vPrev, writes to u and v.
+     *
+     * @param j - The row.
+     * @param dt - How much time passed since last step.
+     * @param pull - How much of the way back to the prevailing wind to go.
+     */
+    void advectRow (int j, float dt, float pull) {
+        const float* __restrict uSrc = &uPrev[0];
+        const float* __restrict vSrc = &vPrev[0];
+        float* __restrict       uDst = &u[j * cols];
+        float* __restrict       vDst = &v[j * cols];
+        float                   tx   = dt / cellx,
+                                ty   = dt / celly,
+                                maxx = cols - 1.f,
+                                maxy = rowCount - 1.f;
+
+        #pragma omp simd
+        for (int i=0; i<cols; i++) {
+            int     cell = j * cols + i;
+            float   gx   = std::min ( std::max (i - uSrc[cell] * tx, 0.f), maxx ),
+                    gy   = std::min ( std::max (j - vSrc[cell] * ty, 0.f), maxy );
+            int     i0   = std::min ( (int) gx, cols - 2 ),
+                    j0   = std::min ( (int) gy, rowCount - 2 ),
+                    c    = j0 * cols + i0;
+            float   fx   = gx - i0,
+                    fy   = gy - j0;
+
+            float   ut   = uSrc[c]        + (uSrc[c + 1]        - uSrc[c])        * fx,
+                    ub   = uSrc[c + cols] + (uSrc[c + cols + 1] - uSrc[c + cols]) * fx,
+                    vt   = vSrc[c]        + (vSrc[c + 1]        - vSrc[c])        * fx,
+                    vb   = vSrc[c + cols] + (vSrc[c + cols + 1] - vSrc[c + cols]) * fx,
+                    uNew = ut + (ub - ut) * fy,
+                    vNew = vt + (vb - vt) * fy;
+
+            uDst[i] = uNew + (windVelocity - uNew) * pull;
+            vDst[i] = vNew - vNew * pull;
+        }
+    }
+};
 
 /**
  * A class for circles that bounce around and absorb eachother.
@@ -66,14 +304,15 @@ public:
      * Updates the disk.
      *
      * @param dt - How much time passed since last update.
+     * @param wind - The wind where the disk is.
      */
-    void update (float dt) {
+    void update (float dt, sf::Vector2f wind) {
 
         // Gravity
         force.y += gravity * mass;
 
         // Wind
-        force.x += fluidConstant * (windVelocity - vel.x) * 2.f*rad;
+        force   += fluidConstant * (wind - vel) * 2.f*rad;
 
         // Apply forces and update position
         vel     += dt * force / mass;
@@ -82,28 +321,572 @@ public:
 
         // Collision with walls
         if (pos.y > windowy - rad) {
-            vel.y *= -0.9f;
+            vel.y *= -restitution;
             pos.y = windowy - rad;
         }
     }
 
-    void draw (sf::RenderWindow& window) {
-        sf::CircleShape     circle;
-        circle.setRadius    ( rad );
-        circle.setFillColor ( color );
-        circle.setOrigin    ( rad, rad );
-        circle.setPosition  ( pos );
-        window.draw(circle);
+};
+
+
+/**
+ * Makes circles bounce off eachother, conserving momentum (heavier circles are pushed less).
+ * The broad-phase is a sort-and-sweep: the world is cut into horizontal strips at least as tall as the largest circle,
+ * and the circles are kept sorted by (strip, left edge). Only neighbours within a strip and the strip below can touch,
+ * and since circles barely move between frames, an insertion sort puts the previous order back in place in about linear time.
+ */
+class SweepAndPrune {
+public:
+
+    /**
+     * Constructor.
+     *
+     * @param height - Height of a strip, grows if a circle is taller.
+     */
+    SweepAndPrune (float height = 30.f) {
+        stripHeight = height;
+    }
+
+    /**
+     * Pushes every pair of overlapping circles apart and bounces them off eachother.
+     * Pairs are resolved one at a time in sweep order; doesn't allocate unless the amount of circles grows.
+     * Circles may be added or removed at the back between solves (a removed circle may be swapped in to replace another).
+     *
+     * @param circles - The circles.
+     */
+    void solve (std::vector <Circle>& circles) {
+        int n = circles.size();
+
+        // The strips have to fit every circle
+        float maxDiameter = 0.f;
+        for (int i=0; i<n; i++) maxDiameter = std::max (maxDiameter, 2.f * circles[i].rad);
+        bool rebuild = false;
+        if (maxDiameter > stripHeight) {
+            stripHeight = maxDiameter;
+            rebuild     = true;
+        }
+
+        // Keep the order of the circles which are still there (circles are only ever added or removed at the back)
+        int oldCount = entries.size();
+        if (n < oldCount) {
+            int kept = 0;
+            for (int k=0; k<oldCount; k++) {
+                if (entries[k].circle < n) entries[kept++] = entries[k];
+            }
+            entries.resize(n);
+        }
+        for (int i=oldCount; i<n; i++) {
+            entries.push_back( Entry { 0, 0.f, 0.f, i } );
+        }
+
+        // Refresh bounds in the current order, then sort
+        for (int k=0; k<n; k++) {
+            Entry&          e = entries[k];
+            const Circle&   c = circles[e.circle];
+            e.strip = (int) std::floor (c.pos.y / stripHeight);
+            e.minx  = c.pos.x - c.rad;
+            e.maxx  = c.pos.x + c.rad;
+        }
+        if (rebuild) std::sort (entries.begin(), entries.end(), precedes);
+        else         insertionSort ();
+
+        // Sweep
+        pairCount       = 0;
+        contactCount    = 0;
+        int below       = 0;    // First entry in the strip below which could still reach the current one
+        for (int k=0; k<n; k++) {
+            const Entry& e = entries[k];
+
+            for (int m=k+1; m<n && entries[m].strip == e.strip && entries[m].minx <= e.maxx; m++) {
+                collide( circles[e.circle], circles[entries[m].circle] );
+            }
+
+            while ( below < n && ( entries[below].strip <= e.strip
+                                || ( entries[below].strip == e.strip + 1 && entries[below].minx < e.minx - stripHeight ) ) ) below++;
+            for (int m=below; m<n && entries[m].strip == e.strip + 1 && entries[m].minx <= e.maxx; m++) {
+                collide( circles[e.circle], circles[entries[m].circle] );
+            }
+        }
+    }
+
+    /**
+     * Gets how many pairs were close enough to be tested during the last solve.
+     *
+     * @return The amount of pairs.
+     */
+    int getPairCount () {
+        return pairCount;
+    }
+
+    /**
+     * Gets how many pairs were overlapping during the last solve.
+     *
+     * @return The amount of contacts.
+     */
+    int getContactCount () {
+        return contactCount;
+    }
+
+private:
+    /**
+     * A circle's place in the sweep order.
+     */
+    struct Entry {
+        int     strip;      //!<  Strip the centre is in
+        float   minx,       //!<  Left edge
+                maxx;       //!<  Right edge
+        int     circle;     //!<  Index of the circle
+    };
+
+    std::vector <Entry> entries;                //!<  Every circle, sorted by (strip, left edge)
+    float               stripHeight;            //!<  Height of a strip
+    int                 pairCount       = 0,    //!<  Pairs tested during the last solve
+                        contactCount    = 0;    //!<  Pairs overlapping during the last solve
+
+    /**
+     * Checks whether an entry comes before another in the sweep order.
+     *
+     * @param a - The first entry.
+     * @param b - The second entry.
+     * @return True if a comes before b.
+     */
+    static bool precedes (const Entry& a, const Entry& b) {
+        return a.strip < b.strip || ( a.strip == b.strip && a.minx < b.minx );
+    }
+
+    /**
+     * Sorts the entries, which are expected to already be nearly sorted.
+     * If too much has moved (like when lots of circles are placed somewhere new), falls back to std::sort.
+     */
+    void insertionSort () {
+        int         n       = entries.size();
+        long long   shifts  = 0,
+                    budget  = 8LL * n + 64;
+
+        for (int k=1; k<n; k++) {
+            Entry   e = entries[k];
+            int     m = k;
+            while ( m > 0 && precedes(e, entries[m - 1]) ) {
+                entries[m] = entries[m - 1];
+                m--;
+            }
+            entries[m]  = e;
+            shifts      += k - m;
+
+            if ( shifts > budget ) {
+                std::sort (entries.begin(), entries.end(), precedes);
+                return;
+            }
+        }
     }
 
+    /**
+     * Separates two circles if they overlap, and bounces them off eachother if they are moving closer.
+     * Neither is pushed through the floor.
+     *
+     * @param a - The first circle.
+     * @param b - The second circle.
+     */
+    void collide (Circle& a, Circle& b) {
+        pairCount++;
+
+        sf::Vector2f    d       = b.pos - a.pos;
+        float           reach   = a.rad + b.rad,
+                        dist2   = d.x*d.x + d.y*d.y;
+        if ( dist2 >= reach * reach ) return;
+        contactCount++;
+
+        float           dist    = sqrt(dist2);
+        sf::Vector2f    normal  = dist > 0.f ? d / dist : sf::Vector2f (1.f, 0.f);
+        float           total   = a.mass + b.mass,
+                        overlap = reach - dist;
+
+        // Push apart, the lighter one more
+        a.pos   -= normal * (overlap * b.mass / total);
+        b.pos   += normal * (overlap * a.mass / total);
+        a.pos.y = std::min (a.pos.y, windowy - a.rad);
+        b.pos.y = std::min (b.pos.y, windowy - b.rad);
+
+        // Bounce, if moving closer
+        float approach = (b.vel.x - a.vel.x) * normal.x + (b.vel.y - a.vel.y) * normal.y;
+        if ( approach < 0.f ) {
+            float impulse = -(1.f + restitution) * approach * a.mass * b.mass / total;
+            a.vel -= normal * (impulse / a.mass);
+            b.vel += normal * (impulse / b.mass);
+        }
+    }
+};
+
+
+/**
+ * A continuous storm of circles, kept in one contiguous block of memory which never grows past its capacity.
+ * The living circles are at the front. A circle which leaves the window is culled by moving the last living circle into its place,
+ * and the emitter refills free slots with fresh circles just past the right edge.
+ */
+class CircleEmitter {
+public:
+    float rate;     //!<  Circles emitted per second (while there are free slots)
+
+    /**
+     * Constructor.
+     *
+     * @param capacity - The most circles that are alive at once.
+     * @param circlesPerSecond - How many circles are emitted per second.
+     * @param generator - Random generator for the new circles.
+     */
+    CircleEmitter (int capacity, float circlesPerSecond, std::mt19937& generator) : gen(generator) {
+        this->capacity = capacity;
+        circles.reserve(capacity);
+        rate = circlesPerSecond;
+    }
+
+    /**
+     * Removes the circles which have been blown out of the window.
+     * Circles may wait past the right edge and above the window, since that's where they come from.
+     *
+     * @return How many circles were removed.
+     */
+    int cull () {
+        int removed = 0;
+        for (int i=0; i<circles.size(); ) {
+            const Circle& c = circles[i];
+            if ( c.pos.x + c.rad < 0.f || c.pos.x - c.rad > windowx * 1.5f || c.pos.y + c.rad < -windowy ) {
+                circles[i] = circles.back();
+                circles.pop_back();
+                removed++;
+            }
+            else i++;
+        }
+        return removed;
+    }
+
+    /**
+     * Emits new circles just past the right edge, as many as the rate allows since last time and the free slots fit.
+     * Doesn't allocate.
+     *
+     * @param dt - How much time passed since last emit.
+     * @return How many circles were emitted.
+     */
+    int emit (float dt) {
+        backlog = std::min ( backlog + rate * dt, (float) capacity );
+
+        int emitted = 0;
+        while ( backlog >= 1.f && circles.size() < capacity ) {
+            float           radius = lerp(5,15,dist(gen));
+            sf::Vector2f    pos    ( windowx + radius + dist(gen) * windowx * 0.25f, lerp( 0, -windowy*0.5f, dist(gen) ) ),
+                            vel    ( lerp(-15.f,15.f,dist(gen)) , lerp(-15.f,15.f,dist(gen)) );
+
+            circles.push_back( Circle ( pos, vel, radius, sf::Color(255,255-255*radius/15.f,0) ) );
+            backlog -= 1.f;
+            emitted++;
+        }
+        return emitted;
+    }
+
+    /**
+     * Gets the living circles.
+     *
+     * @return The circles.
+     */
+    std::vector <Circle>& getCircles () {
+        return circles;
+    }
+
+    /**
+     * Gets the most circles that are alive at once.
+     *
+     * @return The capacity.
+     */
+    int getCapacity () {
+        return capacity;
+    }
+
+private:
+    std::vector <Circle>                    circles;            //!<  Living circles (the capacity is reserved up front)
+    int                                     capacity;           //!<  Most circles alive at once
+    float                                   backlog = 0.f;      //!<  Circles which are due to be emitted
+    std::mt19937&                           gen;                //!<  Random generator for new circles
+    std::uniform_real_distribution <float>  dist {0, 1};        //!<  Uniform distribution in [0, 1)
 };
 
 
+/**
+ * Measures how long the wind field and the circles in it take to step, without a window.
+ * The circles are split into chunks which the threads update in parallel, each sampling the field.
+ *
+ * @param cells - Cells across and down the wind field.
+ * @param circleCount - How many circles are blown around.
+ * @param frames - How many frames to run.
+ * @param threads - How many threads step the field and the circles.
+ */
+void runWindBenchmark (int cells, int circleCount, int frames, int threads) {
+    std::vector <Circle> circles;
+    for (int i=0; i<circleCount; i++) {
+        circles.push_back( Circle ( sf::Vector2f (dist(gen)*windowx, dist(gen)*windowy),
+                                    sf::Vector2f (lerp(-15.f,15.f,dist(gen)), lerp(-15.f,15.f,dist(gen))),
+                                    lerp(5,15,dist(gen)), sf::Color::White ) );
+    }
+
+    ThreadPool  pool (threads);
+    WindField   wind (cells, cells, pool);
+    float       dt          = 1.f / 60.f;
+    int         chunkSize   = 1024,
+                chunkCount  = (circleCount + chunkSize - 1) / chunkSize;
+
+    auto updateJob = [&] (int chunk) {
+        int end = std::min( (chunk + 1) * chunkSize, circleCount );
+        for (int i = chunk * chunkSize; i < end; i++) circles[i].update( dt, wind.sample(circles[i].pos) );
+    };
+
+    sf::Clock   clock;
+    double      fieldSeconds    = 0,
+                circleSeconds   = 0;
+    for (int f=0; f<frames; f++) {
+        // Keep stirring, so the field doesn't settle
+        float angle = 0.1f * f;
+        wind.stir( sf::Vector2f (windowx*(0.5f + 0.3f*cos(angle)), windowy*(0.5f + 0.3f*sin(angle))),
+                   sf::Vector2f (-800.f*sin(angle), 800.f*cos(angle)), windowx*0.1f );
+
+        clock.restart();
+        wind.step(dt);
+        fieldSeconds    += clock.restart().asSeconds();
+        pool.run(chunkCount, updateJob);
+        circleSeconds   += clock.restart().asSeconds();
+    }
+
+    std::cout << "grid:                 " << wind.getColumns() << "x" << wind.getRows()     << std::endl
+              << "circles:              " << circleCount                                    << std::endl
+              << "frames:               " << frames                                         << std::endl
+              << "threads:              " << pool.size()                                    << std::endl
+              << "WindField::step:      " << fieldSeconds * 1000.0 / frames                 << " ms/frame" << std::endl
+              << "Circle::update:       " << circleSeconds * 1000.0 / frames                << " ms/frame" << std::endl;
+}
+
+
+/**
+ * Stacks circles into a pile on the floor, in columns across the window where each circle rests on the one below.
+ *
+ * @param circleCount - How many circles the pile has.
+ * @param gen - Random generator for the radii.
+ * @return The circles.
+ */
+std::vector <Circle> makePile (int circleCount, std::mt19937& gen) {
+    std::uniform_real_distribution <float>  dist (0, 1);
+    std::vector <Circle>                    circles;
+    int                                     columns = windowx / 30;
+    std::vector <float>                     tops    (columns, windowy);
+    for (int i=0; i<circleCount; i++) {
+        int     column = i % columns;
+        float   radius = lerp(10,15,dist(gen));
+        circles.push_back( Circle ( sf::Vector2f (15.f + 30.f * column, tops[column] - radius),
+                                    sf::Vector2f (0,0), radius, sf::Color(255,255-255*radius/15.f,0) ) );
+        tops[column] -= 2.f * radius;
+    }
+    return circles;
+}
+
+
+/**
+ * Measures how long colliding a pile of circles resting on the floor takes, without a window.
+ * The pile is left to settle for a second first.
+ *
+ * @param circleCount - How many circles the pile has.
+ * @param frames - How many frames to run.
+ */
+void runCollisionBenchmark (int circleCount, int frames) {
+    std::mt19937            gen (1234);
+    std::vector <Circle>    circles = makePile(circleCount, gen);
+    SweepAndPrune           collisions;
+    float                   dt      = 1.f / 60.f;
+
+    for (int f=0; f<60; f++) {
+        for (int i=0; i<circles.size(); i++) circles[i].update( dt, sf::Vector2f (0,0) );
+        collisions.solve(circles);
+    }
+
+    sf::Clock   clock;
+    double      updateSeconds   = 0,
+                solveSeconds    = 0,
+                pairs           = 0,
+                contacts        = 0;
+    for (int f=0; f<frames; f++) {
+        clock.restart();
+        for (int i=0; i<circles.size(); i++) circles[i].update( dt, sf::Vector2f (0,0) );
+        updateSeconds   += clock.restart().asSeconds();
+        collisions.solve(circles);
+        solveSeconds    += clock.restart().asSeconds();
+        pairs           += collisions.getPairCount();
+        contacts        += collisions.getContactCount();
+    }
+
+    std::cout << "circles:              " << circleCount                            << std::endl
+              << "frames:               " << frames                                 << std::endl
+              << "pairs tested/frame:   " << pairs / frames                         << std::endl
+              << "contacts/frame:       " << contacts / frames                      << std::endl
+              << "Circle::update:       " << updateSeconds * 1000.0 / frames        << " ms/frame" << std::endl
+              << "SweepAndPrune::solve: " << solveSeconds * 1000.0 / frames         << " ms/frame" << std::endl;
+}
+
+
+/**
+ * Checks whether a circle is (partly) inside the window.
+ *
+ * @param circle - The circle.
+ * @return True if it can be seen.
+ */
+bool isVisible (const Circle& circle) {
+    return circle.pos.x + circle.rad > 0.f && circle.pos.x - circle.rad < windowx
+        && circle.pos.y + circle.rad > 0.f && circle.pos.y - circle.rad < windowy;
+}
+
+
+/**
+ * Runs a storm without a window, the way every frame does (with a fixed timestep), to check that it costs the same over time.
+ * Prints the time and allocations per frame for the first and second half of the frames, and the peak memory.
+ *
+ * @param capacity - The most circles alive at once.
+ * @param frames - How many frames to run.
+ */
+void runStormBenchmark (int capacity, int frames) {
+    std::mt19937    gen (1234);
+    ThreadPool      pool (1);
+    WindField       wind (64, 64, pool);
+    CircleEmitter   emitter (capacity, capacity / 5.f, gen);
+    SweepAndPrune   collisions;
+    CircleBatch     circleBatch;
+    float           dt          = 1.f / 60.f;
+    long long       emitted     = 0,
+                    culled      = 0;
+
+    std::vector <Circle>& circles = emitter.getCircles();
+    sf::Clock clock;
+    for (int half=0; half<2; half++) {
+        long long allocations = allocationCount;
+        clock.restart();
+        for (int f=0; f<frames/2; f++) {
+            culled  += emitter.cull();
+            emitted += emitter.emit(dt);
+            wind.step(dt);
+            for (int i=0; i<circles.size(); i++) circles[i].update( dt, wind.sample(circles[i].pos) );
+            collisions.solve(circles);
+
+            circleBatch.clear();
+            for (int i=0; i<circles.size(); i++) {
+                if ( isVisible(circles[i]) ) circleBatch.add(circles[i].pos, circles[i].rad, circles[i].color);
+            }
+        }
+        float seconds = clock.restart().asSeconds();
+
+        std::cout << (half == 0 ? "first half:           " : "second half:          ")
+                  << seconds * 1000.0 / (frames/2)                                          << " ms/frame, "
+                  << (double) (allocationCount - allocations) / (frames/2)                  << " allocations/frame" << std::endl;
+    }
+
+    rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    std::cout << "capacity:             " << emitter.getCapacity()                             << std::endl
+              << "alive at the end:     " << circles.size()                                    << std::endl
+              << "emitted / culled:     " << emitted << " / " << culled                         << std::endl
+              << "peak memory:          " << usage.ru_maxrss / 1024.0                          << " MiB" << std::endl;
+}
+
+
+/**
+ * Runs the micro-benchmarks without a window and prints the results as JSON (one object per line).
+ * Measures updating the circles, the wind and the collisions of a resting pile, the way every frame does.
+ */
+void runKernelBenchmark () {
+    std::mt19937                            gen (1234);
+    std::uniform_real_distribution <float>  dist (0, 1);
+    std::vector <Circle>                    circles;
+    for (int i=0; i<1000; i++) {
+        circles.push_back( Circle ( sf::Vector2f (dist(gen)*windowx, dist(gen)*windowy),
+                                    sf::Vector2f (lerp(-15.f,15.f,dist(gen)), lerp(-15.f,15.f,dist(gen))),
+                                    lerp(5,15,dist(gen)), sf::Color::White ) );
+    }
+
+    ThreadPool  pool (1);
+    WindField   wind (256, 256, pool);
+    wind.stir( sf::Vector2f (windowx*0.5f, windowy*0.5f), sf::Vector2f (0.f, -500.f), windowx*0.25f );
+
+    int         frames      = 1000;
+    long long   allocations = allocationCount;
+    sf::Clock   clock;
+    clock.restart();
+    for (int f=0; f<frames; f++) {
+        for (int i=0; i<circles.size(); i++) circles[i].update( 1.f / 60.f, wind.sample(circles[i].pos) );
+    }
+    printBenchmark ("windy_balls", "Circle::update", (long long) frames * circles.size(), clock.restart().asSeconds(), allocationCount - allocations);
+
+    int steps   = 100;
+    allocations = allocationCount;
+    clock.restart();
+    for (int f=0; f<steps; f++) wind.step(1.f / 60.f);
+    printBenchmark ("windy_balls", "WindField::step (256x256)", steps, clock.restart().asSeconds(), allocationCount - allocations);
+
+    std::vector <Circle>    pile = makePile(20000, gen);
+    SweepAndPrune           collisions;
+    for (int f=0; f<60; f++) {
+        for (int i=0; i<pile.size(); i++) pile[i].update( 1.f / 60.f, sf::Vector2f (0,0) );
+        collisions.solve(pile);
+    }
+    allocations = allocationCount;
+    clock.restart();
+    for (int f=0; f<steps; f++) {
+        for (int i=0; i<pile.size(); i++) pile[i].update( 1.f / 60.f, sf::Vector2f (0,0) );
+        collisions.solve(pile);
+    }
+    printBenchmark ("windy_balls", "SweepAndPrune::solve (20k pile)", steps, clock.restart().asSeconds(), allocationCount - allocations);
+
+    float sink = wind.sample( sf::Vector2f (windowx*0.5f, windowy*0.5f) ).x + pile[0].pos.y;
+    for (int i=0; i<circles.size(); i++) sink += circles[i].pos.x;
+    if ( sink == 1234.5f ) std::cout << std::endl;  // Keeps the results from being optimized away
+}
+
+
 /**
  * The main program.
+ *
+ * Usage: windy_balls [--render-bench [circles] [frames]]
+ *        windy_balls --wind-bench [cells] [circles] [frames] [threads]
+ *        windy_balls --collision-bench [circles] [frames]
+ *        windy_balls --storm-bench [circles] [frames]
+ *        windy_balls --bench-json
  */
-int main()
+int main(int argc, char* argv[])
 {
+    // Only measure drawing if asked to
+    if (argc > 1 && std::string(argv[1]) == "--render-bench") {
+        int circles = argc > 2 ? atoi(argv[2]) : 10000;
+        int frames  = argc > 3 ? atoi(argv[3]) : 100;
+        runRenderBenchmark(circles, frames);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--wind-bench") {
+        int cells   = argc > 2 ? atoi(argv[2]) : 256;
+        int circles = argc > 3 ? atoi(argv[3]) : 100000;
+        int frames  = argc > 4 ? atoi(argv[4]) : 100;
+        int threads = argc > 5 ? std::max (1, atoi(argv[5])) : std::max (1u, std::thread::hardware_concurrency());
+        runWindBenchmark(cells, circles, frames, threads);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--collision-bench") {
+        int circles = argc > 2 ? atoi(argv[2]) : 20000;
+        int frames  = argc > 3 ? atoi(argv[3]) : 100;
+        runCollisionBenchmark(circles, frames);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--storm-bench") {
+        int circles = argc > 2 ? atoi(argv[2]) : 1000;
+        int frames  = argc > 3 ? atoi(argv[3]) : 3600;
+        runStormBenchmark(circles, frames);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-json") {
+        runKernelBenchmark();
+        return 0;
+    }
+
     // Create clock & window
     sf::RenderWindow window(sf::VideoMode(windowx, windowy), "Windy balls");
 
@@ -111,21 +894,16 @@ int main()
     clock.restart();
     float time = 0.f;
 
-    // Make circles
-    std::vector <Circle*> circles;
-
-    for (int i=0; i<100; i++) {
-        sf::Vector2f    pos     ( lerp( windowx*0.75, windowx*1.25f, dist(gen) ),
-                                  lerp( 0, -windowy*0.5f, dist(gen) )),
-
-                        vel     ( lerp(-15.f,15.f,dist(gen)) , lerp(-15.f,15.f,dist(gen)) );
+    // Make the wind, which the mouse stirs while the left button is held
+    ThreadPool      pool        ( std::max (1u, std::thread::hardware_concurrency()) );
+    WindField       wind        ( 64, 64, pool );
+    sf::Vector2f    lastMouse   ( sf::Mouse::getPosition(window) );
 
-        float           radius = lerp(5,15,dist(gen));
-        sf::Color       color  = sf::Color(255,255-255*radius/15.f,0);
-
-        Circle* circle = new Circle ( pos, vel, radius, color );
-        circles.push_back( circle );
-    }
+    // Make the storm
+    CircleEmitter         emitter     ( 1000, 200.f, gen );
+    std::vector <Circle>& circles   = emitter.getCircles();
+    SweepAndPrune         collisions;
+    CircleBatch           circleBatch;
 
     // Gameloop
     while (window.isOpen())
@@ -144,13 +922,28 @@ int main()
         float dt        = clock.restart().asSeconds();
         time            += dt;
 
-        // Update & draw disks
-        for (int i=0; i<circles.size(); i++) {
-            Circle* circle = circles[i];
+        // Update wind
+        sf::Vector2f mouse ( sf::Mouse::getPosition(window) );
+        if ( sf::Mouse::isButtonPressed(sf::Mouse::Left) && dt > 0.f ) {
+            wind.stir( mouse, (mouse - lastMouse) / dt, 60.f );
+        }
+        lastMouse = mouse;
+        wind.step(dt);
 
-            circle->update(dt);
-            circle->draw(window);
+        // Recycle disks which blew away
+        emitter.cull();
+        emitter.emit(dt);
+
+        // Update & collide disks
+        for (int i=0; i<circles.size(); i++) circles[i].update( dt, wind.sample(circles[i].pos) );
+        collisions.solve(circles);
+
+        // Draw disks (the ones waiting outside the window are skipped)
+        circleBatch.clear();
+        for (int i=0; i<circles.size(); i++) {
+            if ( isVisible(circles[i]) ) circleBatch.add(circles[i].pos, circles[i].rad, circles[i].color);
         }
+        circleBatch.draw(window);
 
         // Display window
         window.display();